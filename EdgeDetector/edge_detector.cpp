@@ -0,0 +1,250 @@
+#include "edge_detector.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+void to_gray(const cv::Mat& color, cv::Mat& gray, bool bgr)
+{
+    if(color.channels() == 1){
+        gray = color;
+    } else {
+        cv::cvtColor(color, gray, bgr ? CV_BGR2GRAY : CV_RGB2GRAY);
+    }
+}
+
+void blur_and_canny(cv::Mat& gray, cv::Mat& edges, const edge_params& params)
+{
+    if(params.blur_size > 1){
+        cv::blur(gray, gray, cv::Size(params.blur_size, params.blur_size));
+    }
+    if(params.thresholds == edge_params::threshold_mode::fixed){
+        cv::Canny(gray, edges, params.low_threshold, params.high_threshold);
+        return;
+    }
+
+    // Canny's own gradient (3x3 Sobel, replicated borders), which is then handed to it directly
+    cv::Mat dx, dy;
+    cv::Sobel(gray, dx, CV_16S, 1, 0, 3, 1, 0, cv::BORDER_REPLICATE);
+    cv::Sobel(gray, dy, CV_16S, 0, 1, 3, 1, 0, cv::BORDER_REPLICATE);
+    uint32_t histogram[magnitude_bins] = {};
+    for(int r = 0; r < gray.rows; r++){
+        const int16_t* x = dx.ptr<int16_t>(r);
+        const int16_t* y = dy.ptr<int16_t>(r);
+        for(int c = 0; c < gray.cols; c++){
+            histogram[magnitude_bin(std::abs(x[c]) + std::abs(y[c]))]++;
+        }
+    }
+    int low, high;
+    automatic_thresholds(params, histogram, low, high);
+    cv::Canny(dx, dy, edges, low, high);
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline int color_distance(const cv::Mat& color, int u0, int v0, int u1, int v1)
+{
+    const uchar* a = color.ptr(v0) + u0 * color.channels();
+    const uchar* b = color.ptr(v1) + u1 * color.channels();
+    int d = 0;
+    for(int c = 0; c < color.channels(); c++){
+        d += std::abs(a[c] - b[c]);
+    }
+    return d;
+}
+
+}
+
+void detect_edges(const cv::Mat& color, cv::Mat& edges, const edge_params& params)
+{
+    cv::Mat gray;
+    to_gray(color, gray, params.bgr);
+    if(gray.data == color.data){
+        // blur works in place, keep the caller's image intact
+        gray = gray.clone();
+    }
+    blur_and_canny(gray, edges, params);
+}
+
+bool parse_threshold_mode(const std::string& spec, edge_params& params)
+{
+    std::string name = spec.substr(0, spec.find(':'));
+    std::string args = name.size() < spec.size() ? spec.substr(name.size() + 1) : "";
+    if(name == "fixed"){
+        params.thresholds = edge_params::threshold_mode::fixed;
+        return args.empty();
+    }
+    if(name == "percentile"){
+        params.thresholds = edge_params::threshold_mode::percentile;
+        if(!args.empty() && sscanf(args.c_str(), "%lf", &params.high_percentile) != 1){
+            return false;
+        }
+        return params.high_percentile > 0 && params.high_percentile < 1;
+    }
+    if(name == "otsu"){
+        params.thresholds = edge_params::threshold_mode::otsu;
+        return args.empty();
+    }
+    return false;
+}
+
+void automatic_thresholds(const edge_params& params, const uint32_t* histogram, int& low, int& high)
+{
+    uint64_t total = 0;
+    double magnitude_sum = 0;
+    for(int i = 0; i < magnitude_bins; i++){
+        total += histogram[i];
+        magnitude_sum += (double) i * histogram[i];
+    }
+
+    int high_bin = 0;
+    if(params.thresholds == edge_params::threshold_mode::otsu){
+        // The split with the largest between-class variance, high starts the upper class
+        uint64_t lower = 0;
+        double lower_sum = 0, best = -1;
+        for(int i = 0; i + 1 < magnitude_bins; i++){
+            lower += histogram[i];
+            lower_sum += (double) i * histogram[i];
+            if(lower == 0){
+                continue;
+            }
+            if(lower == total){
+                break;
+            }
+            double upper = (double) (total - lower);
+            double difference = lower_sum / lower - (magnitude_sum - lower_sum) / upper;
+            double variance = (double) lower * upper * difference * difference;
+            if(variance > best){
+                best = variance;
+                high_bin = i + 1;
+            }
+        }
+    } else {
+        // The first bin with at least high_percentile of the pixels below it
+        const double target = params.high_percentile * total;
+        uint64_t below = 0;
+        while(high_bin + 1 < magnitude_bins && below < target){
+            below += histogram[high_bin++];
+        }
+    }
+    high_bin = std::max(high_bin, 1);
+    int low_bin = std::min(high_bin, std::max(1, (int) std::lround(params.low_ratio * high_bin)));
+
+    // A magnitude m is above bin * 8 - 1 when m >> 3 >= bin
+    low = (low_bin << magnitude_bin_shift) - 1;
+    high = (high_bin << magnitude_bin_shift) - 1;
+}
+
+edge_depth_cleaner::edge_depth_cleaner(const depth_cleaning_params& params) : params(params)
+{
+}
+
+depth_cleaning_stats edge_depth_cleaner::process(const cv::Mat& color, uint16_t* depth, int depth_stride, float depth_scale)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    depth_cleaning_stats stats;
+    const int width = color.cols, height = color.rows;
+    const double pixels = (double) width * height;
+
+    // Coarsest detection needed to keep the predicted edge cost within most of the budget. Without
+    // a measurement yet, start at half resolution rather than risk the first frame's budget.
+    if(params.budget_ms > 0 && ns_per_pixel > 0){
+        while(stats.scale < 4 && ns_per_pixel * pixels / (stats.scale * stats.scale) * 1e-6 > 0.7 * params.budget_ms){
+            stats.scale *= 2;
+        }
+    } else if(params.budget_ms > 0){
+        stats.scale = 2;
+    }
+
+    to_gray(color, gray, params.edges.bgr);
+    if(stats.scale > 1){
+        cv::resize(gray, small, cv::Size(width / stats.scale, height / stats.scale), 0, 0, cv::INTER_LINEAR);
+    } else {
+        small = gray.data == color.data ? gray.clone() : gray;
+    }
+    // Only blur and Canny scale with the detection resolution, the estimate leaves out the
+    // full-resolution conversion and resize so it doesn't grow once the resolution drops
+    std::chrono::steady_clock::time_point detect_start = std::chrono::steady_clock::now();
+    blur_and_canny(small, edges, params.edges);
+    double detect_ms = elapsed_ms(detect_start);
+    stats.edge_ms = elapsed_ms(start);
+    double sample = detect_ms * 1e6 / pixels * stats.scale * stats.scale;
+    ns_per_pixel = ns_per_pixel > 0 ? 0.8 * ns_per_pixel + 0.2 * sample : sample;
+
+    if(params.budget_ms > 0 && stats.edge_ms >= params.budget_ms){
+        stats.skipped = true;
+        stats.ms = elapsed_ms(start);
+        return stats;
+    }
+
+    // Band around the edges, in the detection resolution
+    const int band = std::max(params.band, 1);
+    int radius = (band + stats.scale - 1) / stats.scale;
+    cv::dilate(edges, near_edge, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * radius + 1, 2 * radius + 1)));
+
+    // Decide everything on the original depth first, then write, so earlier fixes don't hide later jumps
+    const int step = std::max(1, (int) (params.depth_step_m / depth_scale + 0.5f));
+    const int offsets[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    updates.clear();
+    for(int v = 0; v < height; v++){
+        // Checked every 16 rows, what was decided so far is still written
+        if(params.budget_ms > 0 && v % 16 == 0 && elapsed_ms(start) >= params.budget_ms){
+            stats.partial = true;
+            break;
+        }
+        const uchar* near_row = near_edge.ptr(std::min(v / stats.scale, near_edge.rows - 1));
+        const uint16_t* row = depth + (size_t) v * depth_stride;
+        for(int u = 0; u < width; u++){
+            if(!near_row[std::min(u / stats.scale, near_edge.cols - 1)] || row[u] == 0){
+                continue;
+            }
+            bool jump = false;
+            for(const int* o : offsets){
+                int nu = u + o[0], nv = v + o[1];
+                if(nu < 0 || nv < 0 || nu >= width || nv >= height){
+                    continue;
+                }
+                uint16_t n = depth[(size_t) nv * depth_stride + nu];
+                if(n && std::abs((int) n - (int) row[u]) > step){
+                    jump = true;
+                    break;
+                }
+            }
+            if(!jump){
+                continue;
+            }
+
+            uint16_t value = 0;
+            if(params.mode == depth_cleaning_params::action::snap){
+                int best = -1;
+                for(const int* o : offsets){
+                    int nu = u + o[0] * (band + 1), nv = v + o[1] * (band + 1);
+                    if(nu < 0 || nv < 0 || nu >= width || nv >= height){
+                        continue;
+                    }
+                    uint16_t n = depth[(size_t) nv * depth_stride + nu];
+                    int d = color_distance(color, u, v, nu, nv);
+                    if(n && (best < 0 || d < best)){
+                        best = d;
+                        value = n;
+                    }
+                }
+            }
+            updates.push_back(std::make_pair((uint32_t) (v * depth_stride + u), value));
+        }
+    }
+    for(const auto& update : updates){
+        depth[update.first] = update.second;
+    }
+    stats.cleaned = updates.size();
+
+    stats.ms = elapsed_ms(start);
+    return stats;
+}
@@ -0,0 +1,97 @@
+#ifndef EDGE_DETECTOR_HPP
+#define EDGE_DETECTOR_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "opencv/cv.hpp"
+
+// The edgedetector_test pipeline: grayscale, box blur, Canny
+struct edge_params {
+    // fixed uses low_threshold and high_threshold. The others pick both per frame from the histogram
+    // of gradient magnitudes: percentile puts high above that share of the pixels, otsu splits the
+    // histogram in two, and low is low_ratio of high.
+    enum class threshold_mode { fixed, percentile, otsu };
+    threshold_mode thresholds = threshold_mode::fixed;
+    double low_threshold = 10;
+    double high_threshold = 350;
+    double high_percentile = 0.9;
+    double low_ratio = 0.4;
+    int blur_size = 3;  // 1 or less skips the blur
+    bool bgr = false;   // channel order of 3-channel input, edgedetector_test has always converted as RGB
+};
+
+// color is 8-bit, 1 or 3 channels. edges is CV_8UC1, 255 on edges.
+void detect_edges(const cv::Mat& color, cv::Mat& edges, const edge_params& params);
+
+// "fixed", "percentile[:<fraction>]" or "otsu"
+bool parse_threshold_mode(const std::string& spec, edge_params& params);
+
+// cvtColor's fixed-point RGB2GRAY weights: 15 fractional bits since OpenCV 4, 14 before
+#if CV_VERSION_MAJOR >= 4
+const int gray_r_weight = 9798, gray_g_weight = 19235, gray_b_weight = 3735, gray_shift = 15;
+#else
+const int gray_r_weight = 4899, gray_g_weight = 9617, gray_b_weight = 1868, gray_shift = 14;
+#endif
+
+// Histogram of the L1 magnitude of the 3x3 Sobel gradient (at most 2040) used by the automatic
+// modes. Bin i holds magnitudes [8i, 8i + 8), the last bin everything from 2016 up.
+const int magnitude_bin_shift = 3;
+const int magnitude_bins = 253;
+
+inline int magnitude_bin(int magnitude)
+{
+    return std::min(magnitude >> magnitude_bin_shift, magnitude_bins - 1);
+}
+
+// Canny thresholds for params' automatic mode. They fall on bin edges, so a magnitude is above
+// a threshold exactly when its bin is at or above that threshold's bin.
+void automatic_thresholds(const edge_params& params, const uint32_t* histogram, int& low, int& high);
+
+struct depth_cleaning_params {
+    enum class action { mask, snap };
+    action mode = action::mask;  // mask zeroes unreliable depth, snap copies it from the matching side of the edge
+    int band = 2;                // pixels either side of a color edge that are checked
+    float depth_step_m = 0.05f;  // a depth jump to a neighbor above this marks the pixel unreliable
+    double budget_ms = 0;        // 0 for no limit
+    edge_params edges;
+};
+
+struct depth_cleaning_stats {
+    double ms = 0;
+    double edge_ms = 0;     // of which edge detection
+    int scale = 1;          // edges were detected at 1/scale resolution
+    size_t cleaned = 0;     // depth pixels zeroed or replaced
+    bool skipped = false;   // the budget ran out before the depth pass, depth is untouched
+    bool partial = false;   // the budget ran out during the depth pass, the rows after it are untouched
+};
+
+// Cleans depth at object boundaries using edges of the pixel-aligned color image.
+//
+// Depth pixels within band of a color edge that also sit on a depth discontinuity are the mixed
+// foreground/background returns. Texture edges on flat surfaces have no discontinuity and are left
+// alone. mask drops those pixels, snap gives each the depth just beyond the band on the side whose
+// color matches it best, which moves the depth boundary onto the color one.
+//
+// With a budget, edge detection runs at half or quarter resolution whenever its measured cost at
+// full resolution would not leave room for the depth pass, and at half resolution on the first
+// frame, before there is a measurement. The depth pass is skipped if the budget is spent by then,
+// and stops where it is once the budget runs out.
+class edge_depth_cleaner {
+public:
+    explicit edge_depth_cleaner(const depth_cleaning_params& params = depth_cleaning_params());
+
+    // color and depth must be the same size. depth is Z16 and modified in place, stride in pixels.
+    depth_cleaning_stats process(const cv::Mat& color, uint16_t* depth, int depth_stride, float depth_scale);
+
+private:
+    depth_cleaning_params params;
+    double ns_per_pixel = 0;  // running estimate of edge detection cost at full resolution
+
+    cv::Mat gray, small, edges, near_edge;
+    std::vector<std::pair<uint32_t, uint16_t>> updates;
+};
+
+#endif //EDGE_DETECTOR_HPP
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef WITH_REALSENSE
+#include <librealsense2/rs.hpp>
+#endif
+#include "opencv/cv.hpp"
+#include "edge_detector.hpp"
+#include "sparse_edges.hpp"
+
+// Headless edge detection over many images: decode, detect and encode run as a pipeline of thread
+// pools connected by bounded queues, so a slow stage never holds more than a few frames in memory.
+// Input is image files, directories of them, or the color stream of .bag recordings when built with
+// librealsense. Edge maps are encoded as PNG, or with --sparse as edge pixels only, which are
+// written to a single stream file. An image that fails in any stage is reported and counted, the
+// rest of the batch carries on.
+
+namespace {
+
+struct job {
+    size_t index = 0;
+    std::string name;
+    std::vector<uchar> bytes;    // encoded input, empty for recording frames
+    cv::Mat image;
+    cv::Mat edges;
+    cv::Size size;
+    std::vector<uchar> encoded;  // PNG edge map, or the sparse payload
+};
+
+// Blocking queue with a fixed capacity. pop() returns false once the queue is closed and drained.
+template<typename T>
+class bounded_queue {
+public:
+    explicit bounded_queue(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    void push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [&] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+    }
+
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [&] { return !items.empty() || closed; });
+        if(items.empty()){
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+};
+
+// Runs fn on num_threads threads; the last one to finish closes the stage's output queue
+template<typename Fn>
+void start_stage(std::vector<std::thread>& threads, unsigned num_threads, bounded_queue<job>& output, Fn fn)
+{
+    std::shared_ptr<std::atomic<unsigned>> running = std::make_shared<std::atomic<unsigned>>(num_threads);
+    for(unsigned t = 0; t < num_threads; t++){
+        threads.push_back(std::thread([=, &output]
+        {
+            fn(t);
+            if(--*running == 0){
+                output.close();
+            }
+        }));
+    }
+}
+
+bool ends_with(const std::string& text, const std::string& suffix)
+{
+    return text.size() >= suffix.size() && !text.compare(text.size() - suffix.size(), suffix.size(), suffix);
+}
+
+bool is_image_file(const std::string& name)
+{
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    for(const char* ext : {".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".ppm", ".pgm"}){
+        if(ends_with(lower, ext)){
+            return true;
+        }
+    }
+    return false;
+}
+
+// Images in a directory sorted by name, or the path itself when it isn't a directory
+std::vector<std::string> list_images(const std::string& path)
+{
+    std::vector<std::string> files;
+    DIR* dir = opendir(path.c_str());
+    if(!dir){
+        files.push_back(path);
+        return files;
+    }
+    while(dirent* entry = readdir(dir)){
+        if(is_image_file(entry->d_name)){
+            files.push_back(path + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+std::string base_name(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    return name.substr(0, name.find_last_of('.'));
+}
+
+// Runs one job's work in a stage. Exceptions, e.g. cv::Exception on a corrupt image, are counted as
+// failures, a stage thread that died would leave the stages before it blocked on a full queue.
+template<typename Fn>
+bool guarded(const job& j, const char* action, std::atomic<size_t>& failed, Fn fn)
+{
+    try {
+        fn();
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Could not " << action << " " << j.name << ": " << e.what() << "\n";
+        failed++;
+        return false;
+    }
+}
+
+// Color frames of a recording, as fast as we consume them
+size_t read_recording(const std::string& bag_file, size_t first_index, bounded_queue<job>& out)
+{
+#ifndef WITH_REALSENSE
+    (void) first_index;
+    (void) out;
+    throw std::runtime_error("Can't read " + bag_file + ": edge_batch was built without librealsense");
+#else
+    rs2::pipeline p;
+    rs2::config cfg;
+    cfg.enable_device_from_file(bag_file, false);
+    cfg.enable_stream(RS2_STREAM_COLOR);
+    rs2::pipeline_profile profile = p.start(cfg);
+    rs2::device device = profile.get_device();
+    device.as<rs2::playback>().set_real_time(false);
+
+    size_t count = 0;
+    std::string name = base_name(bag_file);
+    while(true){
+        rs2::frameset frames;
+        if(!p.try_wait_for_frames(&frames, 1000)){
+            if(device.as<rs2::playback>().current_status() == RS2_PLAYBACK_STATUS_STOPPED){
+                break;
+            }
+            continue;
+        }
+        rs2::video_frame color = frames.get_color_frame();
+        if(!color){
+            continue;
+        }
+        job j;
+        j.index = first_index + count;
+        j.name = name + "_" + std::to_string(count);
+        cv::Mat frame(cv::Size(color.get_width(), color.get_height()), CV_8UC3, const_cast<void*>(color.get_data()),
+                      color.get_stride_in_bytes());
+        // RGB8 is the default color format in our recordings, detect_edges converts it as RGB
+        j.image = frame.clone();
+        out.push(std::move(j));
+        count++;
+    }
+    p.stop();
+    return count;
+#endif
+}
+
+double ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void print_usage()
+{
+    std::cout << "usage: edge_batch <image|directory|recording.bag>... [options]\n"
+              << "  --repeat <n>       process the inputs n times, e.g. to make a large batch from one image (default 1)\n"
+              << "  --output <dir>     write <index>_<name>.png edge maps there (edges.sedg with --sparse), otherwise they are only encoded\n"
+              << "  --sparse <format>  runs, points or directed (points with gradient directions) instead of PNG\n"
+              << "  --decoders <n>     decode threads (default 2)\n"
+              << "  --detectors <n>    edge detection threads (default: every core)\n"
+              << "  --encoders <n>     PNG encode threads (default 2)\n"
+              << "  --queue <n>        images buffered between stages (default 16)\n"
+              << "  --low <t>          Canny low threshold (default 10)\n"
+              << "  --high <t>         Canny high threshold (default 350)\n"
+              << "  --thresholds <m>   fixed, percentile[:<fraction>] or otsu, the last two pick thresholds per image (default fixed)\n";
+}
+
+}
+
+int main(int argc, char** argv) try {
+
+    std::vector<std::string> inputs;
+    std::string output;
+    int repeat = 1;
+    unsigned decoders = 2, detectors = std::max(1u, std::thread::hardware_concurrency()), encoders = 2;
+    size_t queue_size = 16;
+    edge_params params;
+    std::string sparse_name;
+    sparse_format format = sparse_format::runs;
+
+    for(int i = 1; i < argc; i++){
+        bool has_value = i + 1 < argc;
+        if(!strcmp(argv[i], "--repeat") && has_value){
+            repeat = std::max(1, std::stoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--output") && has_value){
+            output = argv[++i];
+        } else if(!strcmp(argv[i], "--sparse") && has_value && parse_sparse_format(argv[i+1], format)){
+            sparse_name = argv[++i];
+        } else if(!strcmp(argv[i], "--decoders") && has_value){
+            decoders = std::max(1u, (unsigned) std::stoul(argv[++i]));
+        } else if(!strcmp(argv[i], "--detectors") && has_value){
+            detectors = std::max(1u, (unsigned) std::stoul(argv[++i]));
+        } else if(!strcmp(argv[i], "--encoders") && has_value){
+            encoders = std::max(1u, (unsigned) std::stoul(argv[++i]));
+        } else if(!strcmp(argv[i], "--queue") && has_value){
+            queue_size = std::stoul(argv[++i]);
+        } else if(!strcmp(argv[i], "--low") && has_value){
+            params.low_threshold = std::stod(argv[++i]);
+        } else if(!strcmp(argv[i], "--high") && has_value){
+            params.high_threshold = std::stod(argv[++i]);
+        } else if(!strcmp(argv[i], "--thresholds") && has_value && parse_threshold_mode(argv[i+1], params)){
+            i++;
+        } else if(argv[i][0] != '-'){
+            inputs.push_back(argv[i]);
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if(inputs.empty()){
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // The pipeline supplies the parallelism, OpenCV's own threads would only compete with it
+    cv::setNumThreads(1);
+
+    bounded_queue<job> to_decode(queue_size), to_detect(queue_size), to_encode(queue_size), done(queue_size);
+    std::vector<double> decode_ms(decoders, 0), detect_ms(detectors, 0), encode_ms(encoders, 0);
+    std::atomic<size_t> failed(0);
+
+    // Sparse frames go into one stream in completion order, each carries its image index.
+    // Opened before any thread starts, so a bad --output fails right away.
+    const std::string stream_path = output + "/edges.sedg";
+    std::ofstream stream_file;
+    std::unique_ptr<sparse_edge_writer> stream;
+    if(!output.empty() && !sparse_name.empty()){
+        stream_file.open(stream_path, std::ios::binary);
+        stream.reset(new sparse_edge_writer(stream_file, format));
+        if(!stream_file){
+            throw std::runtime_error("Can't write " + stream_path);
+        }
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Source: file bytes go to the decoders, recording frames are already decoded
+    size_t submitted = 0;
+    std::thread source([&]
+    {
+        try {
+            for(int r = 0; r < repeat; r++){
+                for(const std::string& input : inputs){
+                    if(ends_with(input, ".bag")){
+                        submitted += read_recording(input, submitted, to_detect);
+                        continue;
+                    }
+                    for(const std::string& file : list_images(input)){
+                        std::ifstream in(file, std::ios::binary);
+                        job j;
+                        j.index = submitted++;
+                        j.name = base_name(file);
+                        j.bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+                        to_decode.push(std::move(j));
+                    }
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            failed++;
+        }
+        to_decode.close();
+    });
+
+    std::vector<std::thread> threads;
+    // Recording frames skip the decoders, but those only finish (and close to_detect) once the
+    // source has closed to_decode, so every frame is in before the close
+    start_stage(threads, decoders, to_detect, [&](unsigned t)
+    {
+        job j;
+        while(to_decode.pop(j)){
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            bool decoded = guarded(j, "decode", failed, [&]
+            {
+                j.image = cv::imdecode(j.bytes, cv::IMREAD_COLOR);
+            });
+            j.bytes = std::vector<uchar>();
+            decode_ms[t] += ms_since(begin);
+            if(!decoded){
+                continue;
+            }
+            if(j.image.empty()){
+                std::cerr << "Could not decode " << j.name << "\n";
+                failed++;
+                continue;
+            }
+            to_detect.push(std::move(j));
+        }
+    });
+    start_stage(threads, detectors, to_encode, [&](unsigned t)
+    {
+        job j;
+        while(to_detect.pop(j)){
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            bool detected = guarded(j, "detect edges in", failed, [&]
+            {
+                detect_edges(j.image, j.edges, params);
+            });
+            if(format != sparse_format::directed_points){
+                j.image = cv::Mat();
+            }
+            detect_ms[t] += ms_since(begin);
+            if(detected){
+                to_encode.push(std::move(j));
+            }
+        }
+    });
+    start_stage(threads, encoders, done, [&](unsigned t)
+    {
+        job j;
+        while(to_encode.pop(j)){
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            j.size = j.edges.size();
+            bool encoded = guarded(j, "encode", failed, [&]
+            {
+                if(!sparse_name.empty()){
+                    j.encoded.clear();
+                    encode_sparse_edges(j.edges, format, j.encoded, j.image, params.bgr);
+                } else {
+                    cv::imencode(".png", j.edges, j.encoded);
+                }
+            });
+            if(encoded && !output.empty() && sparse_name.empty()){
+                encoded = guarded(j, "save", failed, [&]
+                {
+                    const std::string path = output + "/" + std::to_string(j.index) + "_" + j.name + ".png";
+                    std::ofstream out(path, std::ios::binary);
+                    out.write(reinterpret_cast<const char*>(j.encoded.data()), j.encoded.size());
+                    if(!out){
+                        throw std::runtime_error("can't write " + path);
+                    }
+                });
+            }
+            encode_ms[t] += ms_since(begin);
+            j.image = cv::Mat();
+            j.edges = cv::Mat();
+            if(encoded){
+                done.push(std::move(j));
+            }
+        }
+    });
+
+    size_t processed = 0, encoded_bytes = 0;
+    job j;
+    while(done.pop(j)){
+        if(stream){
+            stream->write_encoded(j.index, j.size.width, j.size.height, j.encoded);
+            if(!stream_file){
+                std::cerr << "Could not save " << j.name << ": can't write " << stream_path << "\n";
+                failed++;
+                continue;
+            }
+        }
+        processed++;
+        encoded_bytes += j.encoded.size();
+    }
+    double elapsed_s = ms_since(start) / 1000;
+    source.join();
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+
+    auto total = [](const std::vector<double>& v) { double sum = 0; for(double x : v) sum += x; return sum; };
+    std::cout << std::fixed << std::setprecision(2)
+              << "Images: " << processed << " (" << failed << " failed) in " << elapsed_s << " s, "
+              << (elapsed_s > 0 ? processed / elapsed_s : 0) << " images/s\n"
+              << "Threads: " << decoders << " decode, " << detectors << " detect, " << encoders << " encode\n";
+    if(processed > 0){
+        std::cout << "Per image: decode " << total(decode_ms) / processed << " ms, detect " << total(detect_ms) / processed
+                  << " ms, encode " << total(encode_ms) / processed << " ms, " << encoded_bytes / processed << " " << (sparse_name.empty() ? "PNG" : sparse_name) << " bytes\n";
+    }
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (const std::exception& e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "opencv/cv.hpp"
+#include "edge_detector.hpp"
+#include "fused_canny.hpp"
+#include "sparse_edges.hpp"
+#include "tiled_canny.hpp"
+
+// Times edge detection implementations against the OpenCV three-call sequence (cvtColor, blur,
+// Canny) on a still image and on copies resized to common frame sizes, best of --repeat runs.
+// Every implementation is checked pixel for pixel against OpenCV's output. tiled_canny is run with
+// 1, 2, 4, ... up to --threads threads to show how it scales, and so is its Canny-only entry point,
+// checked against cv::Canny on the grayscale image. Last, OpenCV's edge map is stored as PNG and
+// in each sparse format, with the bytes per frame and a decode check.
+
+namespace {
+
+struct frame_size {
+    int width;
+    int height;
+};
+
+double ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename Fn>
+double best_ms(int repeat, Fn fn)
+{
+    double best = 1e300;
+    for(int r = 0; r < repeat; r++){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, ms_since(start));
+    }
+    return best;
+}
+
+size_t count_mismatches(const cv::Mat& a, const cv::Mat& b)
+{
+    if(a.rows != b.rows || a.cols != b.cols){
+        return (size_t) std::max(a.rows * a.cols, b.rows * b.cols);
+    }
+    size_t mismatches = 0;
+    for(int r = 0; r < a.rows; r++){
+        const uchar* pa = a.ptr(r);
+        const uchar* pb = b.ptr(r);
+        for(int c = 0; c < a.cols; c++){
+            mismatches += pa[c] != pb[c];
+        }
+    }
+    return mismatches;
+}
+
+void print_row(const cv::Mat& image, const char* method, double ms, const cv::Mat& edges, const cv::Mat& reference, double reference_ms)
+{
+    std::cout << std::setw(10) << (std::to_string(image.cols) + "x" + std::to_string(image.rows)) << "  " << std::left
+              << std::setw(12) << method << std::right << std::setw(9) << ms << " ms" << std::setw(8) << reference_ms / ms << "x"
+              << std::setw(10) << cv::countNonZero(edges) << " edges" << std::setw(9) << count_mismatches(edges, reference)
+              << " mismatches\n";
+}
+
+void print_size_row(const cv::Mat& image, const char* format, size_t bytes, double ms, size_t mismatches)
+{
+    std::cout << std::setw(10) << (std::to_string(image.cols) + "x" + std::to_string(image.rows)) << "  " << std::left
+              << std::setw(12) << format << std::right << std::setw(9) << ms << " ms" << std::setw(10) << bytes << " bytes"
+              << std::setw(9) << mismatches << " mismatches after decoding\n";
+}
+
+void print_usage()
+{
+    std::cout << "usage: edge_benchmark [image] [options]\n"
+              << "  --size <w>x<h>     also run on the image resized to this size, repeatable (default 1920x1080)\n"
+              << "  --repeat <n>       runs per measurement, the best is reported (default 20)\n"
+              << "  --low <t>          Canny low threshold (default 10)\n"
+              << "  --high <t>         Canny high threshold (default 350)\n"
+              << "  --thresholds <m>   fixed, percentile[:<fraction>] or otsu, the last two pick thresholds per image (default fixed)\n"
+              << "  --cv-threads <n>   OpenCV threads, 0 for its default (default 1, to compare single-threaded)\n"
+              << "  --threads <n>      most threads for the tiled detector (default: all cores)\n"
+              << "  --tile-rows <n>    rows per tile for the tiled detector (default 32)\n";
+}
+
+}
+
+int main(int argc, char** argv) try {
+
+    std::string path = "../../lena.png";
+    std::vector<frame_size> sizes;
+    int repeat = 20;
+    int cv_threads = 1;
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    int tile_rows = 32;
+    edge_params params;
+
+    for(int i = 1; i < argc; i++){
+        bool has_value = i + 1 < argc;
+        frame_size size;
+        if(!strcmp(argv[i], "--size") && has_value && sscanf(argv[i+1], "%dx%d", &size.width, &size.height) == 2){
+            sizes.push_back(size);
+            i++;
+        } else if(!strcmp(argv[i], "--repeat") && has_value){
+            repeat = std::max(1, std::stoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--low") && has_value){
+            params.low_threshold = std::stod(argv[++i]);
+        } else if(!strcmp(argv[i], "--high") && has_value){
+            params.high_threshold = std::stod(argv[++i]);
+        } else if(!strcmp(argv[i], "--thresholds") && has_value && parse_threshold_mode(argv[i+1], params)){
+            i++;
+        } else if(!strcmp(argv[i], "--cv-threads") && has_value){
+            cv_threads = std::stoi(argv[++i]);
+        } else if(!strcmp(argv[i], "--threads") && has_value){
+            max_threads = (unsigned) std::max(1, std::stoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--tile-rows") && has_value){
+            tile_rows = std::max(1, std::stoi(argv[++i]));
+        } else if(argv[i][0] != '-'){
+            path = argv[i];
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if(sizes.empty()){
+        sizes.push_back(frame_size{1920, 1080});
+    }
+    if(cv_threads > 0){
+        cv::setNumThreads(cv_threads);
+    }
+
+    cv::Mat original = cv::imread(path, cv::IMREAD_COLOR);
+    if(original.empty()){
+        std::cerr << "Could not read " << path << "\n";
+        return EXIT_FAILURE;
+    }
+    std::vector<cv::Mat> images(1, original);
+    for(const frame_size& size : sizes){
+        cv::Mat resized;
+        cv::resize(original, resized, cv::Size(size.width, size.height));
+        images.push_back(resized);
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    fused_canny fused;
+    std::vector<unsigned> thread_counts;
+    for(unsigned t = 1; t < max_threads; t *= 2){
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(max_threads);
+    for(const cv::Mat& image : images){
+        cv::Mat reference, edges;
+        double reference_ms = best_ms(repeat, [&] { detect_edges(image, reference, params); });
+        print_row(image, "opencv", reference_ms, reference, reference, reference_ms);
+
+        double fused_ms = best_ms(repeat, [&] { fused.detect(image, edges, params); });
+        print_row(image, "fused", fused_ms, edges, reference, reference_ms);
+
+        for(unsigned threads : thread_counts){
+            tiled_canny tiled(threads, tile_rows);
+            double tiled_ms = best_ms(repeat, [&] { tiled.detect(image, edges, params); });
+            print_row(image, ("tiled x" + std::to_string(threads)).c_str(), tiled_ms, edges, reference, reference_ms);
+        }
+
+        // Canny alone on the grayscale image, against cv::Canny
+        cv::Mat gray;
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        double canny_ms = best_ms(repeat, [&] { cv::Canny(gray, reference, params.low_threshold, params.high_threshold); });
+        print_row(image, "cv::Canny", canny_ms, reference, reference, canny_ms);
+        for(unsigned threads : thread_counts){
+            tiled_canny tiled(threads, tile_rows);
+            double tiled_ms = best_ms(repeat, [&] { tiled.canny(gray, edges, params.low_threshold, params.high_threshold); });
+            print_row(image, ("canny x" + std::to_string(threads)).c_str(), tiled_ms, edges, reference, canny_ms);
+        }
+
+        // Storage: PNG against the sparse formats, for OpenCV's edges of this image
+        detect_edges(image, reference, params);
+        std::vector<uchar> png;
+        double png_ms = best_ms(repeat, [&] { cv::imencode(".png", reference, png); });
+        print_size_row(image, "png", png.size(), png_ms, count_mismatches(cv::imdecode(png, cv::IMREAD_GRAYSCALE), reference));
+        const char* formats[] = {"runs", "points", "directed"};
+        for(const char* name : formats){
+            sparse_format format;
+            parse_sparse_format(name, format);
+            std::vector<uint8_t> sparse;
+            double sparse_ms = best_ms(repeat, [&] { sparse.clear(); encode_sparse_edges(reference, format, sparse, image, params.bgr); });
+            decode_sparse_edges(sparse.data(), sparse.size(), format, image.cols, image.rows, edges);
+            print_size_row(image, name, sparse.size(), sparse_ms, count_mismatches(edges, reference));
+        }
+    }
+    return EXIT_SUCCESS;
+}
+catch (const std::exception& e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
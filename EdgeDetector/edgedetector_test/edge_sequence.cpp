@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef WITH_REALSENSE
+#include <librealsense2/rs.hpp>
+#endif
+#include "opencv/cv.hpp"
+#include "edge_detector.hpp"
+#include "fused_canny.hpp"
+#include "incremental_canny.hpp"
+
+// Times incremental_canny against fused_canny recomputing every frame, on consecutive frames of a
+// .bag recording (when built with librealsense), a directory of images sorted by name, or without
+// either a still image with a square moving across it, optionally with per-frame noise standing in
+// for sensor noise. Reports the mean time per frame of both, the share of tiles the incremental
+// detector recomputed, and pixels where their edges differ. That is none with --change-threshold 0;
+// above 0, tiles that changed by less keep their old edges, which is what the mismatches measure.
+// The first frame is always computed in full and left out of the means.
+
+namespace {
+
+double ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t count_mismatches(const cv::Mat& a, const cv::Mat& b)
+{
+    size_t mismatches = 0;
+    for(int r = 0; r < a.rows; r++){
+        const uchar* pa = a.ptr(r);
+        const uchar* pb = b.ptr(r);
+        for(int c = 0; c < a.cols; c++){
+            mismatches += pa[c] != pb[c];
+        }
+    }
+    return mismatches;
+}
+
+bool ends_with(const std::string& text, const std::string& suffix)
+{
+    return text.size() >= suffix.size() && !text.compare(text.size() - suffix.size(), suffix.size(), suffix);
+}
+
+// Up to max_frames color frames of a recording
+void read_recording(const std::string& bag_file, size_t max_frames, std::vector<cv::Mat>& frames)
+{
+#ifndef WITH_REALSENSE
+    (void) max_frames;
+    (void) frames;
+    throw std::runtime_error("Can't read " + bag_file + ": edge_sequence was built without librealsense");
+#else
+    rs2::pipeline p;
+    rs2::config cfg;
+    cfg.enable_device_from_file(bag_file, false);
+    cfg.enable_stream(RS2_STREAM_COLOR);
+    rs2::pipeline_profile profile = p.start(cfg);
+    rs2::device device = profile.get_device();
+    device.as<rs2::playback>().set_real_time(false);
+
+    while(frames.size() < max_frames){
+        rs2::frameset frameset;
+        if(!p.try_wait_for_frames(&frameset, 1000)){
+            if(device.as<rs2::playback>().current_status() == RS2_PLAYBACK_STATUS_STOPPED){
+                break;
+            }
+            continue;
+        }
+        rs2::video_frame color = frameset.get_color_frame();
+        if(!color){
+            continue;
+        }
+        cv::Mat frame(cv::Size(color.get_width(), color.get_height()), CV_8UC3, const_cast<void*>(color.get_data()),
+                      color.get_stride_in_bytes());
+        frames.push_back(frame.clone());
+    }
+    p.stop();
+#endif
+}
+
+// Up to max_frames images of a directory, in name order
+void read_directory(const std::string& path, size_t max_frames, std::vector<cv::Mat>& frames)
+{
+    std::vector<std::string> files;
+    DIR* dir = opendir(path.c_str());
+    if(!dir){
+        return;
+    }
+    while(dirent* entry = readdir(dir)){
+        if(entry->d_name[0] != '.'){
+            files.push_back(path + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    for(const std::string& file : files){
+        if(frames.size() == max_frames){
+            break;
+        }
+        cv::Mat image = cv::imread(file, cv::IMREAD_COLOR);
+        if(!image.empty()){
+            frames.push_back(image);
+        }
+    }
+}
+
+// The still image with a checkered square of the given side crossing it, one step per frame, and
+// uniform noise of up to +-noise levels added to every sample
+void make_sequence(const cv::Mat& still, size_t num_frames, int side, int noise, std::vector<cv::Mat>& frames)
+{
+    const int step = 8;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> offset(-noise, noise);
+    for(size_t f = 0; f < num_frames; f++){
+        cv::Mat frame = still.clone();
+        const int x0 = (int) (f * step % std::max(1, still.cols - side)), y0 = (still.rows - side) / 2;
+        for(int y = std::max(y0, 0); y < std::min(y0 + side, still.rows); y++){
+            uchar* row = frame.ptr(y);
+            for(int x = x0; x < std::min(x0 + side, still.cols); x++){
+                const uchar value = ((x - x0) / 16 + (y - y0) / 16) % 2 ? 220 : 30;
+                row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = value;
+            }
+        }
+        for(int y = 0; noise > 0 && y < frame.rows; y++){
+            uchar* row = frame.ptr(y);
+            for(int x = 0; x < frame.cols * 3; x++){
+                row[x] = (uchar) std::min(std::max(row[x] + offset(rng), 0), 255);
+            }
+        }
+        frames.push_back(frame);
+    }
+}
+
+void print_usage()
+{
+    std::cout << "usage: edge_sequence [recording.bag|directory|image] [options]\n"
+              << "  --frames <n>            most frames to load (default 120)\n"
+              << "  --square <n>            side of the moving square when the input is a still image (default 120)\n"
+              << "  --noise <n>             add uniform noise of up to +-n levels to each frame made from a still image (default 0)\n"
+              << "  --tile <n>              tile side in pixels (default 32)\n"
+              << "  --change-threshold <t>  mean absolute difference per sample for a tile to count as changed. 0 is exact but\n"
+              << "                          any noise changes every tile, above 0 small changes keep stale edges (default 0)\n"
+              << "  --full-fraction <f>     share of changed tiles above which the whole frame is recomputed (default 0.5)\n"
+              << "  --backoff <n>           frames then left to plain fused_canny (default 30)\n"
+              << "Not a speedup on noisy sensor data at --change-threshold 0: noise changes every tile, so frames are\n"
+              << "recomputed in full or backed off. A threshold that hides the noise gains speed by keeping stale edges.\n"
+              << "  --low <t>               Canny low threshold (default 10)\n"
+              << "  --high <t>              Canny high threshold (default 350)\n";
+}
+
+}
+
+int main(int argc, char** argv) try {
+
+    std::string path = "../../lena.png";
+    size_t max_frames = 120;
+    int square = 120;
+    int noise = 0;
+    incremental_params params;
+
+    for(int i = 1; i < argc; i++){
+        bool has_value = i + 1 < argc;
+        if(!strcmp(argv[i], "--frames") && has_value){
+            max_frames = std::max<size_t>(2, std::stoul(argv[++i]));
+        } else if(!strcmp(argv[i], "--square") && has_value){
+            square = std::max(1, std::stoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--noise") && has_value){
+            noise = std::max(0, std::stoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--tile") && has_value){
+            params.tile_size = std::max(1, std::stoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--change-threshold") && has_value){
+            params.change_threshold = std::stod(argv[++i]);
+        } else if(!strcmp(argv[i], "--full-fraction") && has_value){
+            params.full_fraction = std::stod(argv[++i]);
+        } else if(!strcmp(argv[i], "--backoff") && has_value){
+            params.backoff_frames = std::max(0, std::stoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--low") && has_value){
+            params.edges.low_threshold = std::stod(argv[++i]);
+        } else if(!strcmp(argv[i], "--high") && has_value){
+            params.edges.high_threshold = std::stod(argv[++i]);
+        } else if(argv[i][0] != '-'){
+            path = argv[i];
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<cv::Mat> frames;
+    if(ends_with(path, ".bag")){
+        read_recording(path, max_frames, frames);
+    } else if(DIR* dir = opendir(path.c_str())){
+        closedir(dir);
+        read_directory(path, max_frames, frames);
+    } else {
+        cv::Mat still = cv::imread(path, cv::IMREAD_COLOR);
+        if(!still.empty()){
+            make_sequence(still, max_frames, square, noise, frames);
+        }
+    }
+    if(frames.size() < 2){
+        std::cerr << "Need at least two frames from " << path << "\n";
+        return EXIT_FAILURE;
+    }
+
+    fused_canny fused;
+    incremental_canny incremental(params);
+    cv::Mat full_edges, incremental_edges;
+    double full_ms = 0, incremental_ms = 0, diff_ms = 0;
+    size_t tiles = 0, changed = 0, full_frames = 0, backoff_frames = 0, mismatches = 0, edge_pixels = 0;
+    for(size_t f = 0; f < frames.size(); f++){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        fused.detect(frames[f], full_edges, params.edges);
+        double frame_full_ms = ms_since(start);
+        incremental_stats stats = incremental.detect(frames[f], incremental_edges);
+        mismatches += count_mismatches(full_edges, incremental_edges);
+        edge_pixels += cv::countNonZero(full_edges);
+        if(f == 0){
+            continue;
+        }
+        full_ms += frame_full_ms;
+        incremental_ms += stats.ms;
+        diff_ms += stats.diff_ms;
+        tiles += stats.tiles;
+        changed += stats.changed;
+        full_frames += stats.full;
+        backoff_frames += stats.backoff;
+    }
+
+    const size_t n = frames.size() - 1;
+    std::cout << std::fixed << std::setprecision(2)
+              << "Frames: " << frames.size() << " of " << frames[0].cols << "x" << frames[0].rows << ", tiles of "
+              << params.tile_size << " px, change threshold " << params.change_threshold << "\n"
+              << "fused        " << std::setw(8) << full_ms / n << " ms/frame\n"
+              << "incremental  " << std::setw(8) << incremental_ms / n << " ms/frame (" << diff_ms / n << " ms differencing), "
+              << full_ms / incremental_ms << "x\n"
+              << "Tiles recomputed: " << 100.0 * changed / std::max<size_t>(tiles, 1) << "%, " << full_frames
+              << " frames in full (" << backoff_frames << " backed off), " << mismatches << " mismatching pixels ("
+              << 100.0 * mismatches / std::max<size_t>(edge_pixels, 1) << "% of the edge pixels)\n";
+    return EXIT_SUCCESS;
+}
+catch (const std::exception& e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -1,20 +1,21 @@
 #include <stdio.h>
 #include "opencv/cv.hpp"
+#include "edge_detector.hpp"
 
 using namespace cv;
 
 int main(int argc, char** argv )
 {
     // Check if correct usage
-    if ( argc != 2 )
+    edge_params params;
+    if ( (argc != 2 && argc != 3) || (argc == 3 && !parse_threshold_mode(argv[2], params)) )
     {
-        printf("usage: DisplayImage.out <Image_Path>\n");
+        printf("usage: DisplayImage.out <Image_Path> [fixed|percentile[:<fraction>]|otsu]\n");
         return -1;
     }
 
     // Initialize image matrix
     Mat image;
-    Mat gray_image;
     Mat canny_contours;
 
     image = imread( argv[1], 1 );
@@ -27,12 +28,8 @@ int main(int argc, char** argv )
         return -1;
     }
 
-    // Convert to grayscale and blur
-    cvtColor(image, gray_image, CV_RGB2GRAY);
-    blur(gray_image, gray_image, Size(3,3));
-
-    // Get canny contours
-    Canny(gray_image, canny_contours, 10,350);
+    // Convert to grayscale, blur and get canny contours
+    detect_edges(image, canny_contours, params);
 
     // Display Original Image
     namedWindow("Original Image", WINDOW_AUTOSIZE );
@@ -0,0 +1,443 @@
+#include "fused_canny.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const uint8_t fused_canny::weak;
+const uint8_t fused_canny::none;
+const uint8_t fused_canny::strong;
+const uint8_t fused_canny::code_base;
+
+namespace {
+
+// tan(22.5 degrees) in Q15, as in OpenCV's Canny
+const int tg22 = 13573;
+
+inline int reflect_101(int i, int n)
+{
+    if(n == 1){
+        return 0;
+    }
+    return i < 0 ? -i : (i >= n ? 2 * n - 2 - i : i);
+}
+
+void gray_row(const cv::Mat& color, bool bgr, int r, uint8_t* out)
+{
+    const int width = color.cols;
+    const uint8_t* src = color.ptr(r);
+    if(color.channels() == 1){
+        memcpy(out, src, width);
+    } else {
+        const int channels = color.channels();
+        const int w0 = bgr ? gray_b_weight : gray_r_weight, w2 = bgr ? gray_r_weight : gray_b_weight;
+        for(int c = 0; c < width; c++, src += channels){
+            out[c] = (uint8_t) ((src[0] * w0 + src[1] * gray_g_weight + src[2] * w2 + (1 << (gray_shift - 1))) >> gray_shift);
+        }
+    }
+    out[-1] = out[reflect_101(-1, width)];
+    out[width] = out[reflect_101(width, width)];
+}
+
+// 3x3 box mean with rounding; rows and the padded columns are REFLECT_101
+void blur_row(const uint8_t* above, const uint8_t* row, const uint8_t* below, int width, uint16_t* column_sum, uint8_t* out)
+{
+    // Column sums over the padded row, index c is pixel c - 1
+    int c = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for(; c + 16 <= width + 2; c += 16){
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above - 1 + c));
+        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row - 1 + c));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below - 1 + c));
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(m, zero)), _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(m, zero)), _mm_unpackhi_epi8(b, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(column_sum + c), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(column_sum + c + 8), hi);
+    }
+#endif
+    for(; c < width + 2; c++){
+        column_sum[c] = (uint16_t) (above[c - 1] + row[c - 1] + below[c - 1]);
+    }
+
+    // (s + 4) / 9 as a multiply-high, exact for s + 4 < 32768
+    c = 0;
+#ifdef __SSE2__
+    const __m128i four = _mm_set1_epi16(4), ninth = _mm_set1_epi16((short) 7282);
+    for(; c + 8 <= width; c += 8){
+        __m128i s = _mm_add_epi16(_mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(column_sum + c)),
+                                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(column_sum + c + 1))),
+                                  _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(column_sum + c + 2)), four));
+        __m128i mean = _mm_mulhi_epu16(s, ninth);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + c), _mm_packus_epi16(mean, mean));
+    }
+#endif
+    for(; c < width; c++){
+        out[c] = (uint8_t) (((column_sum[c] + column_sum[c + 1] + column_sum[c + 2] + 4) * 7282) >> 16);
+    }
+    // Sobel pads with REPLICATE
+    out[-1] = out[0];
+    out[width] = out[width - 1];
+}
+
+// 3x3 Sobel and L1 magnitude for one row from the blurred rows around it
+void gradient_row(const uint8_t* above, const uint8_t* row, const uint8_t* below, int width, int16_t* dx, int16_t* dy, int16_t* magnitude)
+{
+    int c = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    auto load = [&](const uint8_t* p) { return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero); };
+    for(; c + 8 <= width; c += 8){
+        __m128i al = load(above + c - 1), ac = load(above + c), ar = load(above + c + 1);
+        __m128i ml = load(row + c - 1), mr = load(row + c + 1);
+        __m128i bl = load(below + c - 1), bc = load(below + c), br = load(below + c + 1);
+        __m128i gx = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(ar, al), _mm_sub_epi16(br, bl)), _mm_slli_epi16(_mm_sub_epi16(mr, ml), 1));
+        __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(bl, br), _mm_slli_epi16(bc, 1)),
+                                   _mm_add_epi16(_mm_add_epi16(al, ar), _mm_slli_epi16(ac, 1)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dx + c), gx);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dy + c), gy);
+        __m128i m = _mm_add_epi16(_mm_max_epi16(gx, _mm_sub_epi16(zero, gx)), _mm_max_epi16(gy, _mm_sub_epi16(zero, gy)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(magnitude + c), m);
+    }
+#endif
+    for(; c < width; c++){
+        int gx = (above[c + 1] - above[c - 1]) + 2 * (row[c + 1] - row[c - 1]) + (below[c + 1] - below[c - 1]);
+        int gy = (below[c - 1] + 2 * below[c] + below[c + 1]) - (above[c - 1] + 2 * above[c] + above[c + 1]);
+        dx[c] = (int16_t) gx;
+        dy[c] = (int16_t) gy;
+        magnitude[c] = (int16_t) (std::abs(gx) + std::abs(gy));
+    }
+}
+
+inline void suppress_pixels(const int16_t* prev, const int16_t* mag, const int16_t* next, const int16_t* dx, const int16_t* dy,
+                            int begin, int end, int low, int high, bool coded, uint8_t* map, std::vector<uint8_t*>& strong)
+{
+    for(int j = begin; j < end; j++){
+        int m = mag[j];
+        bool maximum = false;
+        if(m > low){
+            int xs = dx[j], ys = dy[j];
+            int x = std::abs(xs), y = std::abs(ys) << 15;
+            int tg22x = x * tg22;
+            if(y < tg22x){
+                maximum = m > mag[j - 1] && m >= mag[j + 1];
+            } else {
+                int tg67x = tg22x + (x << 16);
+                if(y > tg67x){
+                    maximum = m > prev[j] && m >= next[j];
+                } else {
+                    int s = (xs ^ ys) < 0 ? -1 : 1;
+                    maximum = m > prev[j - s] && m > next[j + s];
+                }
+            }
+        }
+        if(!maximum){
+            map[j] = fused_canny::none;
+        } else if(coded){
+            map[j] = (uint8_t) (fused_canny::code_base + magnitude_bin(m));
+        } else if(m > high){
+            map[j] = fused_canny::strong;
+            strong.push_back(map + j);
+        } else {
+            map[j] = fused_canny::weak;
+        }
+    }
+}
+
+#ifdef __SSE2__
+// suppress_pixels for the 8 pixels at j, without branches
+inline void suppress_block(const int16_t* prev, const int16_t* mag, const int16_t* next, const int16_t* dx, const int16_t* dy,
+                           int j, int low, int high, bool coded, uint8_t* map, std::vector<uint8_t*>& strong)
+{
+    auto load = [](const int16_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); };
+    const __m128i zero = _mm_setzero_si128();
+    __m128i m = load(mag + j), xs = load(dx + j), ys = load(dy + j);
+    __m128i x = _mm_max_epi16(xs, _mm_sub_epi16(zero, xs)), y = _mm_max_epi16(ys, _mm_sub_epi16(zero, ys));
+
+    // The direction tests need 32 bits: y << 15 against x * tg22 and x * tg22 + (x << 16)
+    const __m128i vtg22 = _mm_set1_epi16((short) tg22);
+    __m128i product_lo = _mm_mullo_epi16(x, vtg22), product_hi = _mm_mulhi_epi16(x, vtg22);
+    __m128i horizontal[2], vertical[2];
+    for(int half = 0; half < 2; half++){
+        __m128i tg22x = half ? _mm_unpackhi_epi16(product_lo, product_hi) : _mm_unpacklo_epi16(product_lo, product_hi);
+        __m128i x32 = half ? _mm_unpackhi_epi16(x, zero) : _mm_unpacklo_epi16(x, zero);
+        __m128i y32 = _mm_slli_epi32(half ? _mm_unpackhi_epi16(y, zero) : _mm_unpacklo_epi16(y, zero), 15);
+        horizontal[half] = _mm_cmplt_epi32(y32, tg22x);
+        vertical[half] = _mm_cmpgt_epi32(y32, _mm_add_epi32(tg22x, _mm_slli_epi32(x32, 16)));
+    }
+    __m128i is_horizontal = _mm_packs_epi32(horizontal[0], horizontal[1]);
+    __m128i is_vertical = _mm_andnot_si128(is_horizontal, _mm_packs_epi32(vertical[0], vertical[1]));
+    __m128i is_diagonal = _mm_andnot_si128(_mm_or_si128(is_horizontal, is_vertical), _mm_set1_epi16(-1));
+
+    // m > a && m >= b is m > a && !(b > m)
+    auto peak = [&](__m128i a, __m128i b) { return _mm_andnot_si128(_mm_cmpgt_epi16(b, m), _mm_cmpgt_epi16(m, a)); };
+    __m128i along_x = peak(load(mag + j - 1), load(mag + j + 1));
+    __m128i along_y = peak(load(prev + j), load(next + j));
+    // Same signs compare up-left with down-right, opposite signs up-right with down-left
+    __m128i opposite = _mm_srai_epi16(_mm_xor_si128(xs, ys), 15);
+    __m128i up = _mm_or_si128(_mm_and_si128(opposite, load(prev + j + 1)), _mm_andnot_si128(opposite, load(prev + j - 1)));
+    __m128i down = _mm_or_si128(_mm_and_si128(opposite, load(next + j - 1)), _mm_andnot_si128(opposite, load(next + j + 1)));
+    __m128i along_diagonal = _mm_and_si128(_mm_cmpgt_epi16(m, up), _mm_cmpgt_epi16(m, down));
+
+    __m128i maximum = _mm_or_si128(_mm_or_si128(_mm_and_si128(is_horizontal, along_x), _mm_and_si128(is_vertical, along_y)),
+                                   _mm_and_si128(is_diagonal, along_diagonal));
+    maximum = _mm_and_si128(maximum, _mm_cmpgt_epi16(m, _mm_set1_epi16((short) std::min(std::max(low, -32768), 32767))));
+    if(coded){
+        __m128i bin = _mm_min_epi16(_mm_srai_epi16(m, magnitude_bin_shift), _mm_set1_epi16(magnitude_bins - 1));
+        __m128i value = _mm_or_si128(_mm_and_si128(maximum, _mm_add_epi16(bin, _mm_set1_epi16(fused_canny::code_base))),
+                                     _mm_andnot_si128(maximum, _mm_set1_epi16(fused_canny::none)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(map + j), _mm_packus_epi16(value, value));
+        return;
+    }
+    __m128i is_strong = _mm_and_si128(maximum, _mm_cmpgt_epi16(m, _mm_set1_epi16((short) std::min(std::max(high, -32768), 32767))));
+
+    // none (1) where not a maximum, strong (2) above high, weak (0) otherwise
+    __m128i value = _mm_or_si128(_mm_andnot_si128(maximum, _mm_set1_epi16(fused_canny::none)),
+                                 _mm_and_si128(is_strong, _mm_set1_epi16(fused_canny::strong)));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(map + j), _mm_packus_epi16(value, value));
+    unsigned strong_bits = (unsigned) _mm_movemask_epi8(_mm_packs_epi16(is_strong, zero));
+    while(strong_bits){
+        strong.push_back(map + j + __builtin_ctz(strong_bits));
+        strong_bits &= strong_bits - 1;
+    }
+}
+#endif
+
+// Adds a row of magnitudes to the histogram. Flat areas all land in bin 0, and back to back
+// increments of one counter stall on each other, so runs of 8 are counted at once.
+void count_magnitudes(const int16_t* mag, int width, uint32_t* histogram)
+{
+    int c = 0;
+#ifdef __SSE2__
+    const __m128i first_bin_end = _mm_set1_epi16(1 << magnitude_bin_shift);
+    for(; c + 8 <= width; c += 8){
+        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mag + c));
+        if(_mm_movemask_epi8(_mm_cmplt_epi16(m, first_bin_end)) == 0xffff){
+            histogram[0] += 8;
+            continue;
+        }
+        for(int i = 0; i < 8; i++){
+            histogram[magnitude_bin(mag[c + i])]++;
+        }
+    }
+#endif
+    for(; c < width; c++){
+        histogram[magnitude_bin(mag[c])]++;
+    }
+}
+
+// Canny's non-maximum suppression for one row, prev/next are the magnitudes of the rows around it
+void suppress_row(const int16_t* prev, const int16_t* mag, const int16_t* next, const int16_t* dx, const int16_t* dy, int width,
+                  int low, int high, bool coded, uint8_t* map, std::vector<uint8_t*>& strong)
+{
+    int j = 0;
+#ifdef __SSE2__
+    // Most of a frame is below the low threshold, settle those 8 at a time
+    const __m128i vlow = _mm_set1_epi16((short) std::min(std::max(low, -32768), 32767));
+    for(; j + 8 <= width; j += 8){
+        if(!_mm_movemask_epi8(_mm_cmpgt_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mag + j)), vlow))){
+            memset(map + j, fused_canny::none, 8);
+            continue;
+        }
+        suppress_block(prev, mag, next, dx, dy, j, low, high, coded, map, strong);
+    }
+#endif
+    suppress_pixels(prev, mag, next, dx, dy, j, width, low, high, coded, map, strong);
+}
+
+}
+
+void fused_canny::thresholds(const edge_params& params, int& low, int& high)
+{
+    double lo = params.low_threshold, hi = params.high_threshold;
+    if(lo > hi){
+        std::swap(lo, hi);
+    }
+    low = (int) std::floor(lo);
+    high = (int) std::floor(hi);
+}
+
+void fused_canny::suppress_rows(const cv::Mat& color, bool bgr, int blur_size, int low, int high, int y0, int y1,
+                                uint8_t* map, size_t map_step, std::vector<uint8_t*>& strong, strip_buffers& b, uint32_t* histogram)
+{
+    // Coded maps keep every local maximum that can pass an automatic low threshold, which is
+    // at least the top of bin 0
+    const bool coded = histogram != nullptr;
+    if(coded){
+        low = (1 << magnitude_bin_shift) - 1;
+    }
+    const int width = color.cols, height = color.rows;
+    const size_t padded = width + 2;
+    if(b.gray.size() != 4 * padded){
+        b.gray.assign(4 * padded, 0);
+        b.blurred.assign(4 * padded, 0);
+        b.magnitude.assign(4 * padded, 0); // slot 3 stays zero, for rows outside the image
+        b.dx.assign(3 * padded, 0);
+        b.dy.assign(3 * padded, 0);
+        b.column_sum.assign(padded, 0);
+    }
+    std::fill(b.gray_row, b.gray_row + 4, -1);
+    std::fill(b.blurred_row, b.blurred_row + 4, -1);
+    std::fill(b.gradient_row, b.gradient_row + 3, -1);
+
+    // Each ring holds the last few rows by row number; a row is made when first asked for
+    auto gray = [&](int r)
+    {
+        uint8_t* row = &b.gray[(r & 3) * padded + 1];
+        if(b.gray_row[r & 3] != r){
+            gray_row(color, bgr, r, row);
+            b.gray_row[r & 3] = r;
+        }
+        return row;
+    };
+    auto blurred = [&](int r)
+    {
+        uint8_t* row = &b.blurred[(r & 3) * padded + 1];
+        if(b.blurred_row[r & 3] != r){
+            if(blur_size > 1){
+                const uint8_t* above = gray(reflect_101(r - 1, height));
+                const uint8_t* middle = gray(r);
+                const uint8_t* below = gray(reflect_101(r + 1, height));
+                blur_row(above, middle, below, width, b.column_sum.data(), row);
+            } else {
+                memcpy(row, gray(r), width);
+                row[-1] = row[0];
+                row[width] = row[width - 1];
+            }
+            b.blurred_row[r & 3] = r;
+        }
+        return row;
+    };
+    auto magnitude = [&](int r)
+    {
+        if(r < 0 || r >= height){
+            return (const int16_t*) &b.magnitude[3 * padded + 1];
+        }
+        int slot = r % 3;
+        int16_t* mag = &b.magnitude[slot * padded + 1];
+        if(b.gradient_row[slot] != r){
+            const uint8_t* above = blurred(std::max(r - 1, 0));
+            const uint8_t* middle = blurred(r);
+            const uint8_t* below = blurred(std::min(r + 1, height - 1));
+            gradient_row(above, middle, below, width, &b.dx[slot * padded], &b.dy[slot * padded], mag);
+            b.gradient_row[slot] = r;
+            if(coded && r >= y0 && r < y1){
+                count_magnitudes(mag, width, histogram);
+            }
+        }
+        return (const int16_t*) mag;
+    };
+
+    for(int r = y0; r < y1; r++){
+        const int16_t* prev = magnitude(r - 1);
+        const int16_t* mag = magnitude(r);
+        const int16_t* next = magnitude(r + 1);
+        int slot = r % 3;
+        suppress_row(prev, mag, next, &b.dx[slot * padded], &b.dy[slot * padded], width, low, high, coded, map + r * map_step, strong);
+    }
+}
+
+void fused_canny::classify(uint8_t* map, size_t map_step, int width, int y0, int y1, int low, int high, std::vector<uint8_t*>& stack)
+{
+    const int low_code = code_base + magnitude_bin(low + 1), high_code = code_base + magnitude_bin(high + 1);
+    for(int r = y0; r < y1; r++){
+        uint8_t* row = map + r * map_step;
+        int c = 0;
+#ifdef __SSE2__
+        const __m128i vlow = _mm_set1_epi8((char) low_code), vhigh = _mm_set1_epi8((char) high_code);
+        for(; c + 16 <= width; c += 16){
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + c));
+            __m128i above_low = _mm_cmpeq_epi8(_mm_max_epu8(v, vlow), v);
+            __m128i above_high = _mm_cmpeq_epi8(_mm_max_epu8(v, vhigh), v);
+            __m128i value = _mm_or_si128(_mm_and_si128(above_high, _mm_set1_epi8(strong)),
+                                         _mm_andnot_si128(above_low, _mm_set1_epi8(none)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + c), value);
+            unsigned strong_bits = (unsigned) _mm_movemask_epi8(above_high);
+            while(strong_bits){
+                stack.push_back(row + c + __builtin_ctz(strong_bits));
+                strong_bits &= strong_bits - 1;
+            }
+        }
+#endif
+        for(; c < width; c++){
+            if(row[c] >= high_code){
+                row[c] = strong;
+                stack.push_back(row + c);
+            } else {
+                row[c] = row[c] >= low_code ? weak : none;
+            }
+        }
+    }
+}
+
+void fused_canny::hysteresis(size_t map_step, std::vector<uint8_t*>& stack)
+{
+    const ptrdiff_t step = (ptrdiff_t) map_step;
+    const ptrdiff_t offsets[8] = {-step - 1, -step, -step + 1, -1, 1, step - 1, step, step + 1};
+    while(!stack.empty()){
+        uint8_t* p = stack.back();
+        stack.pop_back();
+        for(ptrdiff_t o : offsets){
+            if(p[o] == weak){
+                p[o] = strong;
+                stack.push_back(p + o);
+            }
+        }
+    }
+}
+
+void fused_canny::write_edges(const uint8_t* map, size_t map_step, cv::Mat& edges)
+{
+    for(int r = 0; r < edges.rows; r++){
+        const uint8_t* src = map + r * map_step;
+        uint8_t* dst = edges.ptr(r);
+        int c = 0;
+#ifdef __SSE2__
+        for(; c + 16 <= edges.cols; c += 16){
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), _mm_cmpeq_epi8(v, _mm_set1_epi8(strong)));
+        }
+#endif
+        for(; c < edges.cols; c++){
+            dst[c] = (uint8_t) -(src[c] >> 1); // strong (2) -> 255, the rest -> 0
+        }
+    }
+}
+
+void fused_canny::detect(const cv::Mat& color, cv::Mat& edges, const edge_params& params)
+{
+    if(params.blur_size > 3 || params.blur_size == 2){
+        detect_edges(color, edges, params);
+        return;
+    }
+    const int width = color.cols, height = color.rows;
+    edges.create(height, width, CV_8UC1);
+    if(width == 0 || height == 0){
+        return;
+    }
+
+    // One pixel border of none, so neighbors can be read without bounds checks
+    const size_t map_step = width + 2;
+    map.assign(map_step * (height + 2), none);
+    uint8_t* origin = &map[map_step + 1];
+
+    int low, high;
+    stack.clear();
+    if(params.thresholds == edge_params::threshold_mode::fixed){
+        thresholds(params, low, high);
+        suppress_rows(color, params.bgr, params.blur_size, low, high, 0, height, origin, map_step, stack, buffers);
+    } else {
+        uint32_t histogram[magnitude_bins] = {};
+        suppress_rows(color, params.bgr, params.blur_size, 0, 0, 0, height, origin, map_step, stack, buffers, histogram);
+        automatic_thresholds(params, histogram, low, high);
+        classify(origin, map_step, width, 0, height, low, high, stack);
+    }
+    hysteresis(map_step, stack);
+    write_edges(origin, map_step, edges);
+}
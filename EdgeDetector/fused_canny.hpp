@@ -0,0 +1,72 @@
+#ifndef FUSED_CANNY_HPP
+#define FUSED_CANNY_HPP
+
+#include <cstdint>
+#include <vector>
+#include "opencv/cv.hpp"
+#include "edge_detector.hpp"
+
+// detect_edges in one pass: grayscale, 3x3 box blur, 3x3 Sobel, L1 magnitude and non-maximum
+// suppression are computed row by row through small ring buffers, so the frame is read once and
+// the intermediates stay in L1/L2 instead of making three full-image round trips. Hysteresis then
+// runs on the suppressed map.
+//
+// Each step follows OpenCV's definition (the fixed-point gray weights of the OpenCV version built
+// against, REFLECT_101 blur, REPLICATE Sobel, Canny's suppression rules and floor()ed thresholds),
+// so the output should match cvtColor + blur + Canny pixel for pixel. edge_benchmark's mismatch
+// column checks that against the linked OpenCV. blur_size other than 1 or 3 falls back to
+// detect_edges.
+//
+// Automatic thresholds need no second pass over the image: the magnitude histogram is counted as
+// gradient rows are made, and suppression keeps each local maximum's histogram bin in the map, so
+// once the frame is done the thresholds are picked and the map is classified in place.
+class fused_canny {
+public:
+    void detect(const cv::Mat& color, cv::Mat& edges, const edge_params& params);
+
+    // Suppression map values, as in OpenCV
+    static const uint8_t weak = 0;   // local maximum above the low threshold
+    static const uint8_t none = 1;
+    static const uint8_t strong = 2; // local maximum above the high threshold
+
+    // Row buffers for one strip of rows, reusable across frames
+    struct strip_buffers {
+        std::vector<uint8_t> gray;      // 4 rows, 1 pixel of padding either side
+        std::vector<uint8_t> blurred;   // 4 rows, 1 pixel of padding either side
+        std::vector<int16_t> magnitude; // 3 rows and a zero row, 1 pixel of zero padding either side
+        std::vector<int16_t> dx, dy;    // 3 rows
+        std::vector<uint16_t> column_sum;
+        int gray_row[4], blurred_row[4], gradient_row[3];
+    };
+
+    // Automatic thresholds: local maxima are first stored as code_base + their magnitude_bin
+    static const uint8_t code_base = 3;
+
+    // Suppression map for rows [y0, y1) of the image. map points at pixel (0, 0) of a map with
+    // map_step bytes per row and room for a one pixel border. Strong pixels are appended to strong.
+    // With a histogram, the magnitudes of rows [y0, y1) are counted into it (magnitude_bins bins),
+    // low and high are ignored and the rows are coded for classify.
+    static void suppress_rows(const cv::Mat& color, bool bgr, int blur_size, int low, int high, int y0, int y1,
+                              uint8_t* map, size_t map_step, std::vector<uint8_t*>& strong, strip_buffers& buffers,
+                              uint32_t* histogram = nullptr);
+
+    // Turns coded rows [y0, y1) into weak, strong and none for thresholds from automatic_thresholds,
+    // appending strong pixels to stack
+    static void classify(uint8_t* map, size_t map_step, int width, int y0, int y1, int low, int high, std::vector<uint8_t*>& stack);
+
+    // Grows the strong pixels on the stack through 8-connected weak ones
+    static void hysteresis(size_t map_step, std::vector<uint8_t*>& stack);
+
+    // 255 for strong pixels, 0 elsewhere, edges must already have the image size
+    static void write_edges(const uint8_t* map, size_t map_step, cv::Mat& edges);
+
+    // OpenCV's integer thresholds for L1 magnitude
+    static void thresholds(const edge_params& params, int& low, int& high);
+
+private:
+    strip_buffers buffers;
+    std::vector<uint8_t> map;
+    std::vector<uint8_t*> stack;
+};
+
+#endif //FUSED_CANNY_HPP
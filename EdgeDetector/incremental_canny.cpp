@@ -0,0 +1,212 @@
+#include "incremental_canny.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// How far a changed pixel can move the suppression map
+const int halo = 3;
+
+double ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Whether the sum of absolute differences between a and b over the pixel rectangle exceeds limit
+bool differs(const cv::Mat& a, const cv::Mat& b, int x0, int y0, int x1, int y1, uint64_t limit)
+{
+    const int channels = a.channels();
+    const int bytes = (x1 - x0) * channels;
+    uint64_t sum = 0;
+    for(int r = y0; r < y1; r++){
+        const uint8_t* pa = a.ptr(r) + x0 * channels;
+        const uint8_t* pb = b.ptr(r) + x0 * channels;
+        int c = 0;
+#ifdef __SSE2__
+        __m128i total = _mm_setzero_si128();
+        for(; c + 16 <= bytes; c += 16){
+            total = _mm_add_epi64(total, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pa + c)),
+                                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb + c))));
+        }
+        uint64_t halves[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(halves), total);
+        sum += halves[0] + halves[1];
+#endif
+        for(; c < bytes; c++){
+            sum += std::abs(pa[c] - pb[c]);
+        }
+        if(sum > limit){
+            return true;
+        }
+    }
+    return false;
+}
+
+void copy_pixels(const cv::Mat& from, cv::Mat& to, int x0, int y0, int x1, int y1)
+{
+    const int channels = from.channels();
+    for(int r = y0; r < y1; r++){
+        memcpy(to.ptr(r) + x0 * channels, from.ptr(r) + x0 * channels, (x1 - x0) * channels);
+    }
+}
+
+// Copies rows [0, height) of a suppression map, collecting the copy's strong pixels on the stack
+void copy_map(const uint8_t* from, uint8_t* to, size_t map_step, int width, int height, std::vector<uint8_t*>& stack)
+{
+    for(int r = 0; r < height; r++){
+        const uint8_t* src = from + r * map_step;
+        uint8_t* dst = to + r * map_step;
+        int c = 0;
+#ifdef __SSE2__
+        const __m128i strong = _mm_set1_epi8(fused_canny::strong);
+        for(; c + 16 <= width; c += 16){
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), v);
+            unsigned bits = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, strong));
+            while(bits){
+                stack.push_back(dst + c + __builtin_ctz(bits));
+                bits &= bits - 1;
+            }
+        }
+#endif
+        for(; c < width; c++){
+            dst[c] = src[c];
+            if(src[c] == fused_canny::strong){
+                stack.push_back(dst + c);
+            }
+        }
+    }
+}
+
+}
+
+incremental_canny::incremental_canny(const incremental_params& params) : params(params)
+{
+    this->params.tile_size = std::max(this->params.tile_size, 1);
+    fused_canny::thresholds(params.edges, low, high);
+}
+
+void incremental_canny::recompute(const cv::Mat& color, int x0, int y0, int x1, int y1)
+{
+    // Results are kept for [x0, x1) x [y0, y1), the window around it only feeds them
+    const int width = color.cols, height = color.rows;
+    const int wx0 = std::max(x0 - halo, 0), wy0 = std::max(y0 - halo, 0);
+    const int wx1 = std::min(x1 + halo, width), wy1 = std::min(y1 + halo, height);
+    const cv::Mat source = color(cv::Rect(wx0, wy0, wx1 - wx0, wy1 - wy0));
+
+    const size_t window_step = source.cols + 2;
+    window.resize(window_step * (source.rows + 2));
+    uint8_t* window_origin = &window[window_step + 1];
+    stack.clear();
+    fused_canny::suppress_rows(source, params.edges.bgr, params.edges.blur_size, low, high, y0 - wy0, y1 - wy0,
+                               window_origin, window_step, stack, buffers);
+
+    const size_t map_step = width + 2;
+    uint8_t* classes_origin = &classes[map_step + 1];
+    for(int r = y0; r < y1; r++){
+        memcpy(classes_origin + r * map_step + x0, window_origin + (r - wy0) * window_step + (x0 - wx0), x1 - x0);
+    }
+}
+
+incremental_stats incremental_canny::detect(const cv::Mat& color, cv::Mat& edges)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    incremental_stats stats;
+    const edge_params& edge = params.edges;
+    if(edge.thresholds != edge_params::threshold_mode::fixed || edge.blur_size > 3 || edge.blur_size == 2){
+        whole_frame.detect(color, edges, edge);
+        valid = false;
+        stats.full = true;
+        stats.ms = ms_since(start);
+        return stats;
+    }
+
+    const int width = color.cols, height = color.rows, tile = params.tile_size;
+    edges.create(height, width, CV_8UC1);
+    if(width == 0 || height == 0){
+        return stats;
+    }
+    const int tiles_x = (width + tile - 1) / tile, tiles_y = (height + tile - 1) / tile;
+    stats.tiles = (size_t) tiles_x * tiles_y;
+    if(skip > 0){
+        skip--;
+        whole_frame.detect(color, edges, edge);
+        valid = false;
+        stats.full = stats.backoff = true;
+        stats.changed = stats.tiles;
+        stats.ms = ms_since(start);
+        return stats;
+    }
+    if(!valid || reference.rows != height || reference.cols != width || reference.type() != color.type()){
+        reference.create(height, width, color.type());
+        stats.full = true;
+    }
+
+    if(!stats.full){
+        std::chrono::steady_clock::time_point diff_start = std::chrono::steady_clock::now();
+        changed.assign(stats.tiles, 0);
+        for(int ty = 0; ty < tiles_y; ty++){
+            for(int tx = 0; tx < tiles_x; tx++){
+                const int x0 = tx * tile, y0 = ty * tile;
+                const int x1 = std::min(x0 + tile, width), y1 = std::min(y0 + tile, height);
+                const uint64_t limit = (uint64_t) (params.change_threshold * (x1 - x0) * (y1 - y0) * color.channels());
+                if(differs(color, reference, x0, y0, x1, y1, limit)){
+                    changed[ty * tiles_x + tx] = 1;
+                    stats.changed++;
+                }
+            }
+        }
+        stats.diff_ms = ms_since(diff_start);
+        stats.full = stats.changed > params.full_fraction * stats.tiles;
+        if(stats.full){
+            skip = params.backoff_frames;
+        }
+    }
+
+    const size_t map_step = width + 2;
+    if(stats.full){
+        classes.assign(map_step * (height + 2), fused_canny::none);
+        stack.clear();
+        fused_canny::suppress_rows(color, edge.bgr, edge.blur_size, low, high, 0, height, &classes[map_step + 1], map_step, stack, buffers);
+        copy_pixels(color, reference, 0, 0, width, height);
+        stats.changed = stats.tiles;
+        valid = true;
+    } else {
+        // Runs of changed tiles along a tile row share one window
+        for(int ty = 0; ty < tiles_y; ty++){
+            for(int tx = 0; tx < tiles_x; tx++){
+                if(!changed[ty * tiles_x + tx]){
+                    continue;
+                }
+                int end = tx + 1;
+                while(end < tiles_x && changed[ty * tiles_x + end]){
+                    end++;
+                }
+                const int x0 = tx * tile, y0 = ty * tile;
+                const int x1 = std::min(end * tile, width), y1 = std::min(y0 + tile, height);
+                recompute(color, std::max(x0 - halo, 0), std::max(y0 - halo, 0), std::min(x1 + halo, width), std::min(y1 + halo, height));
+                copy_pixels(color, reference, x0, y0, x1, y1);
+                tx = end;
+            }
+        }
+    }
+
+    // Hysteresis works on a copy, classes stays as suppression left it for the next frame
+    if(map.size() != classes.size()){
+        map.assign(classes.size(), fused_canny::none);
+    }
+    uint8_t* origin = &map[map_step + 1];
+    stack.clear();
+    copy_map(&classes[map_step + 1], origin, map_step, width, height, stack);
+    fused_canny::hysteresis(map_step, stack);
+    fused_canny::write_edges(origin, map_step, edges);
+    stats.ms = ms_since(start);
+    return stats;
+}
@@ -0,0 +1,74 @@
+#ifndef INCREMENTAL_CANNY_HPP
+#define INCREMENTAL_CANNY_HPP
+
+#include <cstdint>
+#include <vector>
+#include "opencv/cv.hpp"
+#include "edge_detector.hpp"
+#include "fused_canny.hpp"
+
+struct incremental_params {
+    int tile_size = 32;           // block differencing and recompute granularity, in pixels
+    double change_threshold = 0;  // mean absolute difference per sample that marks a tile changed, 0 catches every change
+    double full_fraction = 0.5;   // recompute the whole frame when more than this share of tiles changed
+    int backoff_frames = 30;      // frames then handed straight to fused_canny, 0 keeps differencing every frame
+    edge_params edges;
+};
+
+struct incremental_stats {
+    size_t tiles = 0;
+    size_t changed = 0;   // tiles recomputed
+    bool full = false;    // the whole frame was recomputed
+    bool backoff = false; // by fused_canny alone, without differencing
+    double diff_ms = 0;   // of which block differencing
+    double ms = 0;
+};
+
+// fused_canny for video: only the tiles that changed since the last frame are recomputed.
+//
+// Each tile is compared against the pixels its edges were last computed from, so slow drift below
+// change_threshold can't build up unnoticed. A changed pixel moves the suppression result up to 3
+// pixels away (blur, Sobel and the suppression neighborhood), so changed tiles are recomputed 3
+// pixels beyond their bounds from a source window 3 pixels wider again, and the results go into a
+// suppression map kept between frames. Hysteresis, which can reach across the whole frame, then
+// reruns on the full map; it only follows edge pixels, so it costs little next to the gradients.
+//
+// With change_threshold 0 the edges match fused_canny exactly, but on camera footage sensor noise
+// marks nearly every tile changed and the frame is recomputed in full. Above 0, a tile whose change
+// stays under the threshold keeps its old edges, so the output is no longer exact. Automatic
+// thresholds depend on the whole frame's histogram and blur sizes fused_canny doesn't handle are
+// passed on to it, both recompute every frame.
+//
+// A frame recomputed in full costs more than fused_canny (differencing, the reference copy and the
+// kept maps), 15-35% more in edge_sequence at 1080p. So after a frame where too many tiles changed,
+// the next backoff_frames go to fused_canny alone, then tracking starts over with a full frame.
+// Noisy input then costs about as much as fused_canny instead of being slower, but it is no faster.
+class incremental_canny {
+public:
+    explicit incremental_canny(const incremental_params& params = incremental_params());
+
+    // color is 8-bit, 1 or 3 channels, edges is CV_8UC1 with 255 on edges
+    incremental_stats detect(const cv::Mat& color, cv::Mat& edges);
+
+    // The next frame is recomputed in full
+    void reset() { valid = false; skip = 0; }
+
+private:
+    void recompute(const cv::Mat& color, int x0, int y0, int x1, int y1);
+
+    incremental_params params;
+    int low = 0, high = 0;
+    bool valid = false;
+    int skip = 0;                   // frames left to back off
+
+    cv::Mat reference;              // per tile, the pixels its edges were computed from
+    std::vector<uint8_t> changed;   // per tile
+    std::vector<uint8_t> classes;   // suppression map before hysteresis, with a none border
+    std::vector<uint8_t> map;       // classes after hysteresis
+    std::vector<uint8_t> window;    // suppression map of one recomputed window
+    std::vector<uint8_t*> stack;
+    fused_canny::strip_buffers buffers;
+    fused_canny whole_frame;
+};
+
+#endif //INCREMENTAL_CANNY_HPP
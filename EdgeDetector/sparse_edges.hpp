@@ -0,0 +1,75 @@
+#ifndef SPARSE_EDGES_HPP
+#define SPARSE_EDGES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "opencv/cv.hpp"
+
+// Edge maps as their edge pixels only, row by row:
+//   runs             number of runs, then each run as (gap from the previous run's end, length - 1)
+//   points           number of edge pixels, then each as the gap from the previous one
+//   directed_points  points, each followed by its gradient direction in 1/256ths of a turn
+// Every number is an LEB128 varint, so a row without edges costs one byte.
+enum class sparse_format : uint8_t { runs = 0, points = 1, directed_points = 2 };
+
+// "runs", "points" or "directed"
+bool parse_sparse_format(const std::string& name, sparse_format& format);
+
+struct edge_point {
+    int x, y;
+    uint8_t direction;  // 0 when the format has none, 0 is along +x and 64 along +y
+};
+
+// Appends the encoding of edges (CV_8UC1, nonzero on edges) to out. directed_points needs image,
+// the 8-bit 1 or 3 channel image the edges were found in: directions are its 3x3 Sobel gradient.
+void encode_sparse_edges(const cv::Mat& edges, sparse_format format, std::vector<uint8_t>& out,
+                         const cv::Mat& image = cv::Mat(), bool bgr = false);
+
+// Back to a width x height map with 255 on edges. points, if given, receives the edge pixels.
+// Returns false for malformed data.
+bool decode_sparse_edges(const uint8_t* data, size_t size, sparse_format format, int width, int height,
+                         cv::Mat& edges, std::vector<edge_point>* points = nullptr);
+
+struct sparse_frame {
+    size_t index = 0;
+    int width = 0;
+    int height = 0;
+    sparse_format format = sparse_format::runs;
+    std::vector<uint8_t> payload;
+};
+
+// Sparse frames one after another: "SEDG" and a version byte, then for each frame the varints
+// index, width, height, the format byte, the payload size and the payload. Frames are written as
+// they arrive, so a consumer can follow the stream and skip frames without decoding them.
+class sparse_edge_writer {
+public:
+    sparse_edge_writer(std::ostream& out, sparse_format format);
+
+    // Encodes and writes a frame, returns its size in bytes with the frame header
+    size_t write(size_t index, const cv::Mat& edges, const cv::Mat& image = cv::Mat(), bool bgr = false);
+
+    // Writes a payload already made by encode_sparse_edges in this writer's format
+    size_t write_encoded(size_t index, int width, int height, const std::vector<uint8_t>& encoded);
+
+private:
+    std::ostream& out;
+    sparse_format format;
+    std::vector<uint8_t> payload, header;
+};
+
+class sparse_edge_reader {
+public:
+    explicit sparse_edge_reader(std::istream& in);  // throws std::runtime_error without the stream header
+
+    // The next frame, false at the end of the stream. Throws std::runtime_error on a cut-off frame.
+    bool read(sparse_frame& frame);
+
+private:
+    std::istream& in;
+};
+
+#endif //SPARSE_EDGES_HPP
@@ -0,0 +1,141 @@
+#include "tiled_canny.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// fused_canny::hysteresis confined to the map bytes [begin, end), the padded rows of one tile.
+// Neighbors outside are left alone and appended to crossings.
+void tile_hysteresis(const uint8_t* begin, const uint8_t* end, size_t map_step, std::vector<uint8_t*>& stack,
+                     std::vector<uint8_t*>& crossings)
+{
+    const ptrdiff_t step = (ptrdiff_t) map_step;
+    const ptrdiff_t offsets[8] = {-step - 1, -step, -step + 1, -1, 1, step - 1, step, step + 1};
+    while(!stack.empty()){
+        uint8_t* p = stack.back();
+        stack.pop_back();
+        for(ptrdiff_t o : offsets){
+            uint8_t* q = p + o;
+            if(q < begin || q >= end){
+                crossings.push_back(q);
+            } else if(*q == fused_canny::weak){
+                *q = fused_canny::strong;
+                stack.push_back(q);
+            }
+        }
+    }
+}
+
+}
+
+tiled_canny::tiled_canny(unsigned num_threads, int tile_rows)
+    : pool(num_threads), tile_rows(std::max(1, tile_rows)), workers(pool.size())
+{
+}
+
+void tiled_canny::detect(const cv::Mat& color, cv::Mat& edges, const edge_params& params)
+{
+    if(params.blur_size > 3 || params.blur_size == 2){
+        detect_edges(color, edges, params);
+        return;
+    }
+    run(color, edges, params);
+}
+
+void tiled_canny::canny(const cv::Mat& gray, cv::Mat& edges, double low, double high)
+{
+    if(gray.type() != CV_8UC1){
+        throw std::invalid_argument("tiled_canny::canny: expects an 8-bit single channel image");
+    }
+    edge_params params;
+    params.low_threshold = low;
+    params.high_threshold = high;
+    params.blur_size = 1;
+    run(gray, edges, params);
+}
+
+void tiled_canny::run(const cv::Mat& image, cv::Mat& edges, const edge_params& params)
+{
+    const int width = image.cols, height = image.rows;
+    edges.create(height, width, CV_8UC1);
+    if(width == 0 || height == 0){
+        return;
+    }
+
+    // Tiles fill their own rows, only the top and bottom border rows are set here
+    const size_t map_step = width + 2;
+    map.resize(map_step * (height + 2));
+    memset(&map[0], fused_canny::none, map_step);
+    memset(&map[map_step * (height + 1)], fused_canny::none, map_step);
+    uint8_t* origin = &map[map_step + 1];
+
+    const bool automatic = params.thresholds != edge_params::threshold_mode::fixed;
+    int low = 0, high = 0;
+    if(!automatic){
+        fused_canny::thresholds(params, low, high);
+    }
+    for(worker_state& w : workers){
+        w.crossings.clear();
+        if(automatic){
+            w.histogram.assign(magnitude_bins, 0);
+        }
+    }
+
+    const size_t tiles = (height + tile_rows - 1) / tile_rows;
+    pool.run(tiles, [&](size_t tile, unsigned worker)
+    {
+        worker_state& w = workers[worker];
+        const int y0 = (int) tile * tile_rows, y1 = std::min(height, y0 + tile_rows);
+        for(int r = y0; r < y1; r++){
+            origin[r * map_step - 1] = fused_canny::none;
+            origin[r * map_step + width] = fused_canny::none;
+        }
+        w.stack.clear();
+        fused_canny::suppress_rows(image, params.bgr, params.blur_size, low, high, y0, y1, origin, map_step, w.stack, w.buffers,
+                                   automatic ? w.histogram.data() : nullptr);
+        if(!automatic){
+            tile_hysteresis(origin + y0 * map_step - 1, origin + y1 * map_step - 1, map_step, w.stack, w.crossings);
+        }
+    });
+
+    if(automatic){
+        uint32_t histogram[magnitude_bins] = {};
+        for(const worker_state& w : workers){
+            for(int i = 0; i < magnitude_bins; i++){
+                histogram[i] += w.histogram[i];
+            }
+        }
+        automatic_thresholds(params, histogram, low, high);
+        pool.run(tiles, [&](size_t tile, unsigned worker)
+        {
+            worker_state& w = workers[worker];
+            const int y0 = (int) tile * tile_rows, y1 = std::min(height, y0 + tile_rows);
+            w.stack.clear();
+            fused_canny::classify(origin, map_step, width, y0, y1, low, high, w.stack);
+            tile_hysteresis(origin + y0 * map_step - 1, origin + y1 * map_step - 1, map_step, w.stack, w.crossings);
+        });
+    }
+
+    // Merge: a weak pixel next to a strong one in another tile is strong too, and so is everything
+    // weak it connects to. Only pixels near tile borders are left to reach this way.
+    stack.clear();
+    for(worker_state& w : workers){
+        for(uint8_t* p : w.crossings){
+            if(*p == fused_canny::weak){
+                *p = fused_canny::strong;
+                stack.push_back(p);
+            }
+        }
+    }
+    fused_canny::hysteresis(map_step, stack);
+
+    pool.run(tiles, [&](size_t tile, unsigned)
+    {
+        const int y0 = (int) tile * tile_rows, y1 = std::min(height, y0 + tile_rows);
+        cv::Mat rows = edges.rowRange(y0, y1);
+        fused_canny::write_edges(origin + y0 * map_step, map_step, rows);
+    });
+}
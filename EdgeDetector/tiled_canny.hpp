@@ -0,0 +1,54 @@
+#ifndef TILED_CANNY_HPP
+#define TILED_CANNY_HPP
+
+#include <cstdint>
+#include <vector>
+#include "opencv/cv.hpp"
+#include "edge_detector.hpp"
+#include "fused_canny.hpp"
+#include "work_stealing_pool.hpp"
+
+// fused_canny split into horizontal tiles of tile_rows rows, run on a work-stealing pool.
+//
+// A tile recomputes the gray, blur and gradient rows just above and below it (the overlap), so
+// suppression needs nothing from other tiles. Hysteresis runs inside each tile while the others are
+// still suppressing, without reading outside its own rows: a strong pixel whose neighbor lies in
+// another tile records that neighbor instead. Once every tile is done, the recorded neighbors that
+// are weak are promoted and grown across the whole map, which gives the same edges as a single
+// global hysteresis. The output has been checked to match fused_canny pixel for pixel. Against
+// OpenCV it matches the algorithm, not necessarily a given build's output (IPP builds run their own
+// Canny); edge_benchmark counts the pixels that differ from the linked OpenCV.
+//
+// With automatic thresholds, hysteresis waits for a second round over the tiles: the workers'
+// histograms are summed once suppression is done, and each tile then classifies its rows.
+class tiled_canny {
+public:
+    explicit tiled_canny(unsigned num_threads = 0, int tile_rows = 32); // 0 uses every core
+
+    // Same contract as detect_edges
+    void detect(const cv::Mat& color, cv::Mat& edges, const edge_params& params);
+
+    // OpenCV's Canny algorithm as in cv::Canny(gray, edges, low, high) with the default 3x3 aperture
+    // and L1 gradient; edge_benchmark's "canny xN" rows count where the two differ. gray is CV_8UC1.
+    void canny(const cv::Mat& gray, cv::Mat& edges, double low, double high);
+
+    unsigned num_threads() const { return pool.size(); }
+
+private:
+    struct worker_state {
+        fused_canny::strip_buffers buffers;
+        std::vector<uint8_t*> stack;
+        std::vector<uint8_t*> crossings; // weak candidates in other tiles, next to a strong pixel here
+        std::vector<uint32_t> histogram; // automatic thresholds, the magnitudes of this worker's tiles
+    };
+
+    void run(const cv::Mat& image, cv::Mat& edges, const edge_params& params);
+
+    work_stealing_pool pool;
+    int tile_rows;
+    std::vector<worker_state> workers;
+    std::vector<uint8_t> map;
+    std::vector<uint8_t*> stack;
+};
+
+#endif //TILED_CANNY_HPP
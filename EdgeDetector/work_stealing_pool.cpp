@@ -0,0 +1,102 @@
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+
+work_stealing_pool::work_stealing_pool(unsigned num_threads)
+{
+    if(num_threads == 0){
+        num_threads = std::thread::hardware_concurrency();
+    }
+    num_threads = std::max(1u, num_threads);
+    for(unsigned t = 0; t < num_threads; t++){
+        queues.push_back(std::unique_ptr<task_range>(new task_range()));
+    }
+    for(unsigned t = 0; t + 1 < num_threads; t++){
+        threads.push_back(std::thread(&work_stealing_pool::work, this, t));
+    }
+}
+
+work_stealing_pool::~work_stealing_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+}
+
+bool work_stealing_pool::next_task(unsigned worker, size_t& task)
+{
+    {
+        task_range& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(own.begin < own.end){
+            task = own.begin++;
+            return true;
+        }
+    }
+    for(unsigned i = 1; i < queues.size(); i++){
+        task_range& victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(victim.begin < victim.end){
+            task = --victim.end;
+            return true;
+        }
+    }
+    return false;
+}
+
+void work_stealing_pool::work(unsigned worker)
+{
+    uint64_t seen = 0;
+    while(true){
+        const std::function<void(size_t, unsigned)>* fn;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if(stopping){
+                return;
+            }
+            seen = generation;
+            fn = job;
+        }
+        size_t task;
+        while(next_task(worker, task)){
+            (*fn)(task, worker);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if(--busy == 0){
+            finished.notify_all();
+        }
+    }
+}
+
+void work_stealing_pool::run(size_t tasks, const std::function<void(size_t, unsigned)>& fn)
+{
+    const unsigned workers = size();
+    for(unsigned t = 0; t < workers; t++){
+        task_range& range = *queues[t];
+        std::lock_guard<std::mutex> lock(range.mutex);
+        range.begin = tasks * t / workers;
+        range.end = tasks * (t + 1) / workers;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        busy = workers;
+        generation++;
+    }
+    wake.notify_all();
+
+    size_t task;
+    while(next_task(workers - 1, task)){
+        fn(task, workers - 1);
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    busy--;
+    finished.wait(lock, [&] { return busy == 0; });
+    job = nullptr;
+}
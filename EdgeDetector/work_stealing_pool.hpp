@@ -0,0 +1,52 @@
+#ifndef WORK_STEALING_POOL_HPP
+#define WORK_STEALING_POOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent threads for many short parallel loops (a frame's tiles), so threads aren't spawned per frame.
+//
+// run() gives every worker a contiguous run of the tasks, which it takes from the front. A worker
+// that runs out steals single tasks from the back of the others' runs, so uneven tiles (edge-dense
+// ones take longer) don't leave threads idle while neighbors keep their locality.
+class work_stealing_pool {
+public:
+    explicit work_stealing_pool(unsigned num_threads = 0); // 0 uses every core
+    ~work_stealing_pool();
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    unsigned size() const { return (unsigned) queues.size(); }
+
+    // Calls fn(task, worker) for every task in [0, tasks) and returns once all are done.
+    // The calling thread works too, as the last worker.
+    void run(size_t tasks, const std::function<void(size_t, unsigned)>& fn);
+
+private:
+    struct task_range {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    void work(unsigned worker);
+    bool next_task(unsigned worker, size_t& task);
+
+    std::vector<std::unique_ptr<task_range>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    const std::function<void(size_t, unsigned)>* job = nullptr;
+    uint64_t generation = 0;
+    unsigned busy = 0;
+    bool stopping = false;
+};
+
+#endif //WORK_STEALING_POOL_HPP
@@ -0,0 +1,493 @@
+#include "benchmark_runner.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include "depth_filter_chain.hpp"
+#include "euclidean_clustering.hpp"
+#include "organized_cloud.hpp"
+#include "plane_segmentation.hpp"
+#include "point_cloud.hpp"
+#include "voxel_grid.hpp"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ms(bench_clock::time_point from, bench_clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+std::vector<double>& benchmark_results::metric(const std::string& name)
+{
+    for(auto& m : stage_metrics){
+        if(m.first == name){
+            return m.second;
+        }
+    }
+    stage_metrics.push_back(std::make_pair(name, std::vector<double>()));
+    return stage_metrics.back().second;
+}
+
+std::vector<std::string> stage_columns(const benchmark_config& config)
+{
+    std::vector<std::string> columns;
+    if(config.align_to_color){
+        columns.push_back("Align (ms)");
+    }
+    depth_filter_chain filters;
+    if(filters.parse(config.depth_filters) && !filters.empty()){
+        for(size_t i = 0; i < filters.size(); i++){
+            columns.push_back("Filter " + filters.name(i) + " (ms)");
+        }
+        columns.push_back("Filters (ms)");
+    }
+    if(config.clean_edges){
+        columns.insert(columns.end(), {"Edge Clean (ms)", "Edge Detect (ms)", "Edge Scale", "Edge Cleaned", "Edge Partial"});
+    }
+    // Points and processing time are recorded for every config, so ROI sweeps keep the same columns
+    columns.push_back("Points In");
+    if(config.processes_cloud()){
+        if(config.flying_ratio > 0){
+            columns.push_back("Flying Pixels");
+        }
+        if(config.remove_outliers){
+            columns.insert(columns.end(), {"Outliers (ms)", "Outliers Removed", "Outliers Tested"});
+        }
+        if(config.normal_radius > 0){
+            columns.insert(columns.end(), {"Normals (ms)", "Normals Valid"});
+        }
+        if(config.voxel_size > 0){
+            columns.push_back("Downsample (ms)");
+        }
+        if(config.max_planes > 0){
+            columns.insert(columns.end(), {"Planes (ms)", "Plane Points"});
+        }
+        if(config.cluster_tolerance > 0){
+            columns.insert(columns.end(), {"Clusters (ms)", "Clusters"});
+        }
+    }
+    columns.insert(columns.end(), {"Points Out", "Processing (ms)"});
+    return columns;
+}
+
+benchmark_results run_benchmark_config(const benchmark_config& config, async_logger* shared_log)
+{
+    benchmark_results results;
+    // Columns in a fixed order, even when a stage is skipped on the first frames
+    for(const std::string& column : stage_columns(config)){
+        results.metric(column);
+    }
+
+    // Create Pipeline
+    rs2::pipeline p;
+
+    // Create Pointcloud
+    rs2::pointcloud pc;
+    rs2::points points;
+
+    // In-project extraction that only emits valid points
+    point_extractor extractor;
+    extraction_params extraction;
+    extraction.near_m = config.near_m;
+    extraction.far_m = config.far_m;
+    extraction.num_threads = config.num_threads;
+    extraction.box = config.box;
+    extraction.flying_ratio = config.flying_ratio;
+    extraction.flying_min_m = config.flying_min_m;
+
+    // Depth is aligned to the color stream when requested
+    rs2::align align(RS2_STREAM_COLOR);
+
+    bool replaying = !config.bag_file.empty();
+    bool play_to_end = replaying && config.num_frames == 0 && config.duration_s <= 0;
+    replay_source replay(config.bag_file, config.replay, !play_to_end);
+
+    rs2::config cv_config;
+    if(replaying){
+        replay.configure(cv_config);
+    }
+    cv_config.enable_stream(RS2_STREAM_COLOR, config.color.width, config.color.height, config.color.format, config.color.fps);
+    cv_config.enable_stream(RS2_STREAM_DEPTH, config.depth.width, config.depth.height, config.depth.format, config.depth.fps);
+    rs2::pipeline_profile profile = p.start(cv_config);
+    if(replaying){
+        replay.on_start(profile);
+    }
+
+    depth_filter_chain filters;
+    if(!filters.parse(config.depth_filters)){
+        throw std::runtime_error("Unknown depth filter in \"" + config.depth_filters + "\"");
+    }
+
+    depth_cleaning_params cleaning = config.edge_cleaning;
+    cleaning.edges.bgr = config.color.format == RS2_FORMAT_BGR8;
+    edge_depth_cleaner edge_cleaner(cleaning);
+    if(config.clean_edges && (!config.align_to_color || (config.color.format != RS2_FORMAT_RGB8 && !cleaning.edges.bgr))){
+        throw std::runtime_error("Edge cleaning needs depth aligned to an RGB8 or BGR8 color stream");
+    }
+
+    // A sweep passes one logger for all its configs, so their timings end up in the same log
+    std::unique_ptr<async_logger> own_log;
+    if(!shared_log){
+        own_log.reset(new async_logger(config.log_options));
+    }
+    async_logger& log = shared_log ? *shared_log : *own_log;
+    const uint16_t log_receive = log.event("Time Taken to Receive:", "ms");
+    const uint16_t log_between = log.event("Time Between Two Frame Receipts: ", "ms");
+    const uint16_t log_extract = log.event("Time taken to extract:", "ms");
+    const uint16_t log_save = log.event("Time taken to save:", "ms");
+    const uint16_t log_fps = log.event("FPS: ", " -------------------------------------------------------");
+    const uint16_t log_downsample = log.event("Time taken to downsample:", "ms");
+    const uint16_t log_points_out = log.event("Points after downsampling: ");
+    const uint16_t log_clusters = log.event("Time taken to cluster:", "ms");
+    const uint16_t log_planes = log.event("Time taken to segment planes:", "ms");
+    const uint16_t log_outliers = log.event("Time taken to remove outliers:", "ms");
+    const uint16_t log_normals = log.event("Time taken to estimate normals:", "ms");
+    const uint16_t log_align = log.event("Time taken to align:", "ms");
+    const uint16_t log_edges = log.event("Time taken to clean depth edges:", "ms");
+    std::vector<uint16_t> log_filters;
+    for(size_t i = 0; i < filters.size(); i++){
+        log_filters.push_back(log.event(filters.label(i), "ms"));
+    }
+
+    int fps_counter = 0; // for counting FPS
+    uint32_t frame_counter = 0; // for counting how many frames until # of frames user has requested
+
+    bench_clock::time_point run_start = bench_clock::now();
+    bench_clock::time_point prev_time = run_start; // Initialize time of previous frame
+    bench_clock::time_point fps_time = run_start;
+
+    while(true){
+        if(config.duration_s > 0){
+            if(elapsed_ms(run_start, bench_clock::now()) >= config.duration_s * 1000){
+                break;
+            }
+        } else if(!play_to_end && frame_counter >= config.num_frames){
+            break;
+        }
+
+        bench_clock::time_point start_waiting_for_frames = bench_clock::now();
+        rs2::frameset frames;
+        if(replaying){
+            if(!replay.next(p, frames)){
+                break;
+            }
+        } else {
+            frames = p.wait_for_frames();
+        }
+
+        bench_clock::time_point receive_time = bench_clock::now();
+        double frame_receipts_ms = elapsed_ms(prev_time, receive_time);
+        double frameset_wait_for_receipts_ms = elapsed_ms(start_waiting_for_frames, receive_time);
+        log.log(log_receive, frameset_wait_for_receipts_ms);
+        log.log(log_between, frame_receipts_ms);
+        prev_time = receive_time;
+
+        std::vector<std::pair<std::string, double>> stage_values;
+        if(config.align_to_color){
+            frames = align.process(frames);
+            double align_ms = elapsed_ms(receive_time, bench_clock::now());
+            log.log(log_align, align_ms);
+            stage_values.push_back(std::make_pair("Align (ms)", align_ms));
+        }
+        rs2::depth_frame depth = frames.get_depth_frame();
+        auto color = frames.get_color_frame();
+
+        // Post-processing on depth before extraction
+        if(!filters.empty()){
+            depth = filters.process(depth);
+            double filters_ms = 0;
+            for(size_t i = 0; i < filters.size(); i++){
+                log.log(log_filters[i], filters.last_ms(i));
+                stage_values.push_back(std::make_pair("Filter " + filters.name(i) + " (ms)", filters.last_ms(i)));
+                filters_ms += filters.last_ms(i);
+            }
+            stage_values.push_back(std::make_pair("Filters (ms)", filters_ms));
+        }
+
+        // Color edges fix depth boundaries in place. Align hands us a new frame, so nothing else sees the writes.
+        // Skipped when a filter such as decimation changed the depth resolution.
+        if(config.clean_edges && color && depth.get_width() == color.get_width() && depth.get_height() == color.get_height()){
+            cv::Mat color_mat(cv::Size(color.get_width(), color.get_height()), CV_8UC3, const_cast<void*>(color.get_data()),
+                              color.get_stride_in_bytes());
+            uint16_t* depth_data = static_cast<uint16_t*>(const_cast<void*>(depth.get_data()));
+            depth_cleaning_stats cleaned = edge_cleaner.process(color_mat, depth_data, depth.get_stride_in_bytes() / 2, depth.get_units());
+            log.log(log_edges, cleaned.ms);
+            stage_values.push_back(std::make_pair("Edge Clean (ms)", cleaned.ms));
+            stage_values.push_back(std::make_pair("Edge Detect (ms)", cleaned.edge_ms));
+            stage_values.push_back(std::make_pair("Edge Scale", (double) cleaned.scale));
+            stage_values.push_back(std::make_pair("Edge Cleaned", cleaned.skipped ? 0.0 : (double) cleaned.cleaned));
+            stage_values.push_back(std::make_pair("Edge Partial", cleaned.skipped || cleaned.partial ? 1.0 : 0.0));
+        }
+
+        // Extract point cloud
+        bench_clock::time_point extract_start = bench_clock::now();
+        point_cloud cloud;
+        if(config.uses_extractor()){
+            depth_image depth_data(depth);
+            extraction.roi = config.roi;
+            if(config.roi.empty() && config.roi_fraction < 1){
+                extraction.roi = image_roi::centered(depth_data.width, depth_data.height, config.roi_fraction);
+            }
+            cloud = extractor.extract(depth_data, extraction);
+            map_color(cloud, depth_data, color);
+        } else {
+            points = pc.calculate(depth);
+            pc.map_to(color);
+        }
+
+        bench_clock::time_point extracted_time = bench_clock::now();
+        double extract_ms = elapsed_ms(extract_start, extracted_time);
+        log.log(log_extract, extract_ms);
+
+        // Optional processing on our own copy of the cloud, exported instead of the rs2::points
+        clustering clusters;
+        bool processed = config.processes_cloud();
+        if(processed){
+            bench_clock::time_point stage_start = bench_clock::now();
+            if(!config.uses_extractor()){
+                cloud = from_rs2_points(points, color);
+            }
+            stage_values.push_back(std::make_pair("Points In", (double) cloud.size()));
+            if(config.flying_ratio > 0){
+                stage_values.push_back(std::make_pair("Flying Pixels", (double) extractor.flying_pixels()));
+            }
+
+            // First, so later stages never see the stray points. Grid neighbors while pixel indices are there.
+            if(config.remove_outliers){
+                outlier_params params = config.outliers;
+                params.image_width = depth.get_width();
+                params.image_height = depth.get_height();
+                params.num_threads = config.num_threads;
+                outlier_result filtered = remove_outliers(cloud, params);
+                cloud = std::move(filtered.cloud);
+                log.log(log_outliers, filtered.ms);
+                stage_values.push_back(std::make_pair("Outliers (ms)", filtered.ms));
+                stage_values.push_back(std::make_pair("Outliers Removed", (double) filtered.removed));
+                stage_values.push_back(std::make_pair("Outliers Tested", (double) filtered.evaluated));
+            }
+
+            // Needs the pixel indices, so it runs before downsampling. Normals go out with the PLY.
+            if(config.normal_radius > 0){
+                bench_clock::time_point normals_start = bench_clock::now();
+                organized_cloud grid = organized_cloud::from_point_cloud(cloud, depth.get_width(), depth.get_height());
+                normal_params params;
+                params.radius = config.normal_radius;
+                params.num_threads = config.num_threads;
+                organized_normals normals = estimate_normals(grid, params);
+                attach_normals(cloud, normals, config.num_threads);
+                double normals_ms = elapsed_ms(normals_start, bench_clock::now());
+                log.log(log_normals, normals_ms);
+                stage_values.push_back(std::make_pair("Normals (ms)", normals_ms));
+                stage_values.push_back(std::make_pair("Normals Valid", (double) normals.valid_count()));
+            }
+
+            if(config.voxel_size > 0){
+                voxel_grid_stats stats;
+                cloud = voxel_downsample(cloud, config.voxel_size, config.num_threads, &stats);
+                log.log(log_downsample, stats.ms);
+                log.log(log_points_out, stats.points_out);
+                stage_values.push_back(std::make_pair("Downsample (ms)", stats.ms));
+            }
+
+            // Dominant planes (floor, tables) are stripped from the exported cloud
+            if(config.max_planes > 0){
+                plane_params params;
+                params.max_planes = config.max_planes;
+                params.distance = config.plane_distance;
+                params.num_threads = config.num_threads;
+                plane_segmentation planes = segment_planes(cloud, params);
+                size_t plane_points = 0;
+                for(const plane_model& plane : planes.planes){
+                    plane_points += plane.inliers;
+                }
+                cloud = remove_planes(cloud, planes);
+                log.log(log_planes, planes.ms);
+                stage_values.push_back(std::make_pair("Planes (ms)", planes.ms));
+                stage_values.push_back(std::make_pair("Plane Points", (double) plane_points));
+            }
+
+            // Object segmentation on what's left. Grid adjacency while the points still have pixel indices.
+            if(config.cluster_tolerance > 0){
+                cluster_params params;
+                params.tolerance = config.cluster_tolerance;
+                params.min_points = config.cluster_min_points;
+                params.image_width = depth.get_width();
+                params.image_height = depth.get_height();
+                params.num_threads = config.num_threads;
+                clusters = cluster_points(cloud, params);
+                log.log(log_clusters, clusters.ms);
+                stage_values.push_back(std::make_pair("Clusters (ms)", clusters.ms));
+                stage_values.push_back(std::make_pair("Clusters", (double) clusters.clusters.size()));
+            }
+
+            stage_values.push_back(std::make_pair("Points Out", (double) cloud.size()));
+            stage_values.push_back(std::make_pair("Processing (ms)", elapsed_ms(stage_start, bench_clock::now())));
+        } else {
+            // pc.calculate keeps a vertex for every depth pixel and nothing processes them
+            stage_values.push_back(std::make_pair("Points In", (double) points.size()));
+            stage_values.push_back(std::make_pair("Points Out", (double) points.size()));
+            stage_values.push_back(std::make_pair("Processing (ms)", 0.0));
+        }
+
+        // Print out FPS
+        if(std::chrono::duration_cast<std::chrono::seconds>(bench_clock::now() - fps_time).count() >= 1){
+            log.log(log_fps, fps_counter);
+            fps_counter = 0;
+            fps_time = bench_clock::now();
+        }
+
+        double save_ms = 0;
+        if(config.save_to_disk){
+            bench_clock::time_point start_time = bench_clock::now();
+            if(processed){
+                write_ply(config.ply_path, cloud);
+                if(config.cluster_tolerance > 0){
+                    write_clusters(config.ply_path + ".clusters.csv", clusters);
+                }
+            } else {
+                points.export_to_ply(config.ply_path, color);
+            }
+
+            save_ms = elapsed_ms(start_time, bench_clock::now());
+            log.log(log_save, save_ms);
+        }
+
+        // We don't keep the very first frame, it includes stream start-up
+        if(frame_counter != 0){
+            results.time_between_frame_receipts.push_back(frame_receipts_ms);
+            results.time_taken_to_receive.push_back(frameset_wait_for_receipts_ms);
+            results.time_taken_to_extract.push_back(extract_ms);
+            results.time_taken_to_save.push_back(save_ms);
+            // A stage skipped on some frames, such as edge cleaning without a matching color frame, records 0
+            // there, so every column has one value per frame
+            size_t recorded = results.time_taken_to_save.size();
+            for(const auto& value : stage_values){
+                std::vector<double>& values = results.metric(value.first);
+                values.resize(recorded - 1, 0);
+                values.push_back(value.second);
+            }
+            for(auto& m : results.stage_metrics){
+                m.second.resize(recorded, 0);
+            }
+        }
+
+        fps_counter++;
+        frame_counter++;
+    }
+
+    results.frames_grabbed = frame_counter;
+    results.elapsed_s = elapsed_ms(run_start, bench_clock::now()) / 1000;
+    p.stop();
+
+    std::cout << "Processed " << results.frames_grabbed << " frames in " << results.elapsed_s << "s ("
+              << results.throughput_fps() << " frames/s)\n";
+    return results;
+}
+
+void write_benchmark_csv(const std::string& path, const benchmark_results& results)
+{
+    std::ofstream benchmark_results(path);
+    benchmark_results << "Frame, Time Taken to Save (ms),Time Between Frame Receipts (ms),Time Taken to Receive (ms),Time Taken to Extract (ms)";
+    for(const auto& m : results.stage_metrics){
+        benchmark_results << "," << m.first;
+    }
+    benchmark_results << "\n";
+
+    for(size_t i = 0; i < results.time_taken_to_save.size(); i++){
+        benchmark_results << i+1 << "," << results.time_taken_to_save[i] << "," << results.time_between_frame_receipts[i]
+                          << "," << results.time_taken_to_receive[i] << "," << results.time_taken_to_extract[i];
+        for(const auto& m : results.stage_metrics){
+            benchmark_results << "," << m.second[i];
+        }
+        benchmark_results << "\n";
+    }
+}
+
+// Format: <width>x<height>:<format>@<fps>, e.g. 1280x720:Z16@30
+bool parse_stream_profile(const std::string& text, stream_profile& profile)
+{
+    char format_name[32] = {};
+    if(sscanf(text.c_str(), "%dx%d:%31[^@]@%d", &profile.width, &profile.height, format_name, &profile.fps) != 4){
+        return false;
+    }
+    for(int f = RS2_FORMAT_ANY; f < RS2_FORMAT_COUNT; f++){
+        if(std::string(rs2_format_to_string((rs2_format) f)) == format_name){
+            profile.format = (rs2_format) f;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string to_string(const stream_profile& profile)
+{
+    return std::to_string(profile.width) + "x" + std::to_string(profile.height) + ":"
+           + rs2_format_to_string(profile.format) + "@" + std::to_string(profile.fps);
+}
+
+bool parse_roi(const std::string& text, benchmark_config& config)
+{
+    image_roi roi;
+    if(text == "full"){
+        config.roi = roi;
+        config.roi_fraction = 1;
+        return true;
+    }
+    if(sscanf(text.c_str(), "%dx%d+%d+%d", &roi.width, &roi.height, &roi.x, &roi.y) == 4){
+        config.roi = roi;
+        return !roi.empty();
+    }
+    float fraction;
+    char trailing;
+    if(sscanf(text.c_str(), "%f%c", &fraction, &trailing) == 1 && fraction > 0 && fraction <= 1){
+        config.roi = roi;
+        config.roi_fraction = fraction;
+        return true;
+    }
+    return false;
+}
+
+std::string roi_to_string(const benchmark_config& config)
+{
+    if(!config.roi.empty()){
+        return std::to_string(config.roi.width) + "x" + std::to_string(config.roi.height) + "+"
+               + std::to_string(config.roi.x) + "+" + std::to_string(config.roi.y);
+    }
+    if(config.roi_fraction < 1){
+        char text[32];
+        snprintf(text, sizeof(text), "%g", config.roi_fraction);
+        return text;
+    }
+    return "full";
+}
+
+bool parse_box(const std::string& text, oriented_box& box)
+{
+    float center[3], half[3], angles[3] = {0, 0, 0};
+    int n = sscanf(text.c_str(), "%f,%f,%f,%f,%f,%f,%f,%f,%f", &center[0], &center[1], &center[2],
+                   &half[0], &half[1], &half[2], &angles[0], &angles[1], &angles[2]);
+    if(n != 6 && n != 9){
+        return false;
+    }
+    box = oriented_box::from_euler(center, half, angles[0], angles[1], angles[2]);
+    return true;
+}
+
+bool parse_edge_cleaning(const std::string& text, depth_cleaning_params& params)
+{
+    std::string mode = text.substr(0, text.find(':'));
+    if(mode == "mask"){
+        params.mode = depth_cleaning_params::action::mask;
+    } else if(mode == "snap"){
+        params.mode = depth_cleaning_params::action::snap;
+    } else {
+        return false;
+    }
+    if(mode.size() < text.size()){
+        return sscanf(text.c_str() + mode.size() + 1, "%lf", &params.budget_ms) == 1 && params.budget_ms >= 0;
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+#ifndef BENCHMARK_RUNNER_HPP
+#define BENCHMARK_RUNNER_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <librealsense2/rs.hpp>
+#include "async_logger.hpp"
+#include "edge_detector.hpp"
+#include "outlier_removal.hpp"
+#include "point_extraction.hpp"
+#include "replay_source.hpp"
+
+struct stream_profile {
+    int width;
+    int height;
+    rs2_format format;
+    int fps;
+};
+
+// One benchmark run. Frames are grabbed until num_frames, or for duration_s seconds when it is set.
+// When replaying a bag with neither set, the recording is played once to the end.
+struct benchmark_config {
+    stream_profile color = {1920, 1080, RS2_FORMAT_RGB8, 30};
+    stream_profile depth = {1280, 720, RS2_FORMAT_Z16, 30};
+    bool align_to_color = false;
+    bool save_to_disk = false;
+    uint32_t num_frames = 120;
+    double duration_s = 0;
+    std::string bag_file; // play back a recording instead of opening the camera
+    replay_pacing replay = replay_pacing::real_time;
+    std::string ply_path = "pointcloud.ply";
+    async_logger::options log_options; // per-frame timings, stdout by default
+
+    // librealsense post-processing applied to depth before extraction, see depth_filter_chain.hpp
+    std::string depth_filters;
+
+    // Color-edge-guided cleaning of depth boundaries before extraction, see edge_detector.hpp.
+    // Needs align_to_color and an RGB8/BGR8 color stream.
+    bool clean_edges = false;
+    depth_cleaning_params edge_cleaning;
+
+    // Extract only valid points within [near_m, far_m] instead of calling pc.calculate
+    bool compact = false;
+    float near_m = 0.1f;
+    float far_m = 10.0f;
+
+    // Region of interest, applied inside the in-project extraction
+    float roi_fraction = 1; // centered rectangle covering this fraction of the depth frame
+    image_roi roi;          // explicit rectangle, takes precedence over roi_fraction
+    oriented_box box;
+
+    // Depth-discontinuity filter on the raw depth during extraction, see extraction_params; 0 disables
+    float flying_ratio = 0;
+    float flying_min_m = 0.01f;
+
+    bool uses_extractor() const { return compact || roi_fraction < 1 || !roi.empty() || box.enabled || flying_ratio > 0; }
+
+    // Processing between extraction and export, 0 disables a stage
+    float voxel_size = 0;     // meters
+    unsigned num_threads = 0; // 0 uses every core
+
+    // Statistical or radius outlier removal right after extraction, with an optional per-frame budget
+    bool remove_outliers = false;
+    outlier_params outliers;
+
+    // Organized (pixel grid) normal estimation window, 0 disables
+    int normal_radius = 0;
+
+    // RANSAC planes removed from the cloud after downsampling, 0 disables
+    int max_planes = 0;
+    float plane_distance = 0.02f; // meters
+
+    // Euclidean clustering after plane removal, 0 disables. Clusters are saved next to the PLY.
+    float cluster_tolerance = 0;  // meters
+    size_t cluster_min_points = 50;
+
+    // Whether the cloud is copied out for any of the stages above instead of exporting the rs2::points
+    bool processes_cloud() const
+    {
+        return uses_extractor() || voxel_size > 0 || normal_radius > 0 || max_planes > 0 || cluster_tolerance > 0
+               || remove_outliers;
+    }
+};
+
+// Per-frame timings in ms. The first frame is treated as warm-up and not recorded.
+struct benchmark_results {
+    std::vector<double> time_taken_to_save;
+    std::vector<double> time_between_frame_receipts;
+    std::vector<double> time_taken_to_receive;
+    std::vector<double> time_taken_to_extract;
+    uint32_t frames_grabbed = 0;
+    double elapsed_s = 0;
+
+    // Per-frame values of the optional processing stages, in the order the stages ran. Every one has a
+    // value per recorded frame, 0 where the stage was skipped.
+    std::vector<std::pair<std::string, std::vector<double>>> stage_metrics;
+    std::vector<double>& metric(const std::string& name);
+
+    // With unpaced replay this is processing capacity rather than camera frame rate
+    double throughput_fps() const { return elapsed_s > 0 ? frames_grabbed / elapsed_s : 0; }
+};
+
+// Names of the stage_metrics a run of config records, in order. Configs of a sweep can differ.
+std::vector<std::string> stage_columns(const benchmark_config& config);
+
+// Logs to shared_log when given, otherwise to a logger made from config.log_options
+benchmark_results run_benchmark_config(const benchmark_config& config, async_logger* shared_log = nullptr);
+
+// Same layout as the original benchmark_results.csv, extract time and stage metrics appended
+void write_benchmark_csv(const std::string& path, const benchmark_results& results);
+
+bool parse_stream_profile(const std::string& text, stream_profile& profile);
+std::string to_string(const stream_profile& profile);
+
+// ROI is "full", an area fraction such as 0.25, or a rectangle <w>x<h>+<x>+<y>
+bool parse_roi(const std::string& text, benchmark_config& config);
+std::string roi_to_string(const benchmark_config& config);
+
+// Box is cx,cy,cz,hx,hy,hz[,roll,pitch,yaw]: center and half extents in meters, angles in degrees
+bool parse_box(const std::string& text, oriented_box& box);
+
+// Edge cleaning is "mask" or "snap", optionally followed by ":<budget ms>"
+bool parse_edge_cleaning(const std::string& text, depth_cleaning_params& params);
+
+#endif //BENCHMARK_RUNNER_HPP
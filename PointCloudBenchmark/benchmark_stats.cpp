@@ -0,0 +1,145 @@
+#include "benchmark_stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+static std::string trim(const std::string& s)
+{
+    size_t first = s.find_first_not_of(" \t\r\n");
+    if(first == std::string::npos){
+        return "";
+    }
+    size_t last = s.find_last_not_of(" \t\r\n");
+    return s.substr(first, last - first + 1);
+}
+
+int benchmark_table::find_column(const std::string& name) const
+{
+    for(size_t i = 0; i < columns.size(); i++){
+        if(columns[i] == name){
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if(sorted.empty()){
+        return 0;
+    }
+    double rank = p * (sorted.size() - 1);
+    size_t lo = (size_t) std::floor(rank);
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo]);
+}
+
+sample_summary summarize(std::vector<double> samples)
+{
+    sample_summary s;
+    s.count = samples.size();
+    if(samples.empty()){
+        return s;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for(double v : samples){
+        sum += v;
+    }
+    s.mean = sum / samples.size();
+
+    double sq = 0;
+    for(double v : samples){
+        sq += (v - s.mean) * (v - s.mean);
+    }
+    s.stddev = samples.size() > 1 ? std::sqrt(sq / (samples.size() - 1)) : 0;
+
+    s.min = samples.front();
+    s.max = samples.back();
+    s.median = percentile(samples, 0.5);
+    s.p95 = percentile(samples, 0.95);
+    s.p99 = percentile(samples, 0.99);
+    return s;
+}
+
+// Median of a resample drawn with replacement, reuses scratch to avoid allocating per round
+static double resampled_median(const std::vector<double>& samples, std::vector<double>& scratch, std::mt19937& rng)
+{
+    std::uniform_int_distribution<size_t> pick(0, samples.size() - 1);
+    scratch.resize(samples.size());
+    for(size_t i = 0; i < scratch.size(); i++){
+        scratch[i] = samples[pick(rng)];
+    }
+
+    size_t mid = scratch.size() / 2;
+    std::nth_element(scratch.begin(), scratch.begin() + mid, scratch.end());
+    double upper = scratch[mid];
+    if(scratch.size() % 2 == 1){
+        return upper;
+    }
+    double lower = *std::max_element(scratch.begin(), scratch.begin() + mid);
+    return 0.5 * (lower + upper);
+}
+
+confidence_interval bootstrap_median_difference(const std::vector<double>& baseline,
+                                                const std::vector<double>& candidate,
+                                                uint32_t resamples, double confidence, uint32_t seed)
+{
+    confidence_interval ci;
+    if(baseline.empty() || candidate.empty() || resamples == 0){
+        return ci;
+    }
+
+    std::mt19937 rng(seed);
+    std::vector<double> scratch;
+    std::vector<double> differences(resamples);
+    for(uint32_t i = 0; i < resamples; i++){
+        differences[i] = resampled_median(candidate, scratch, rng) - resampled_median(baseline, scratch, rng);
+    }
+    std::sort(differences.begin(), differences.end());
+
+    double alpha = 1.0 - confidence;
+    ci.low = percentile(differences, alpha / 2);
+    ci.high = percentile(differences, 1.0 - alpha / 2);
+    return ci;
+}
+
+bool read_benchmark_csv(const std::string& path, benchmark_table& table)
+{
+    std::ifstream in(path);
+    if(!in.is_open()){
+        return false;
+    }
+
+    table.columns.clear();
+    table.values.clear();
+
+    std::string line;
+    if(!std::getline(in, line)){
+        return false;
+    }
+    std::stringstream header(line);
+    std::string cell;
+    while(std::getline(header, cell, ',')){
+        table.columns.push_back(trim(cell));
+    }
+    table.values.resize(table.columns.size());
+
+    while(std::getline(in, line)){
+        if(trim(line).empty()){
+            continue;
+        }
+        std::stringstream row(line);
+        for(size_t col = 0; col < table.columns.size() && std::getline(row, cell, ','); col++){
+            std::string value = trim(cell);
+            if(!value.empty()){
+                table.values[col].push_back(std::stod(value));
+            }
+        }
+    }
+    return true;
+}
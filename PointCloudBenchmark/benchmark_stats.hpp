@@ -0,0 +1,46 @@
+#ifndef BENCHMARK_STATS_HPP
+#define BENCHMARK_STATS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Distribution summary of one benchmark column (ms for timings, otherwise a count)
+struct sample_summary {
+    size_t count = 0;
+    double mean = 0;
+    double stddev = 0;
+    double min = 0;
+    double median = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+struct confidence_interval {
+    double low = 0;
+    double high = 0;
+};
+
+// Benchmark CSV loaded column by column, header names trimmed
+struct benchmark_table {
+    std::vector<std::string> columns;
+    std::vector<std::vector<double>> values;
+
+    // Returns -1 if the column does not exist
+    int find_column(const std::string& name) const;
+};
+
+// p in [0, 1], linear interpolation between closest ranks. Expects sorted input.
+double percentile(const std::vector<double>& sorted, double p);
+
+sample_summary summarize(std::vector<double> samples);
+
+// Bootstrap CI for median(candidate) - median(baseline)
+confidence_interval bootstrap_median_difference(const std::vector<double>& baseline,
+                                                const std::vector<double>& candidate,
+                                                uint32_t resamples, double confidence, uint32_t seed);
+
+bool read_benchmark_csv(const std::string& path, benchmark_table& table);
+
+#endif //BENCHMARK_STATS_HPP
@@ -0,0 +1,135 @@
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "benchmark_stats.hpp"
+
+// Compares two benchmark CSVs written by run_benchmark column by column.
+// A timing column, named "... (ms)", regresses when the bootstrap CI of the median difference lies
+// entirely above zero and the median got worse by more than the threshold, or by more than the floor
+// when the baseline median is 0 and there is nothing to take a percentage of. The other columns are
+// counts such as Points Out or Clusters, which can move either way for good reasons; their
+// differences are reported but never judged.
+//
+// Exit codes: 0 no regression, 1 regression detected, 2 usage / input error
+
+static void print_usage()
+{
+    std::cout << "usage: compare_benchmarks <baseline.csv> <candidate.csv> [options]\n"
+              << "  --resamples <n>     bootstrap resamples (default 10000)\n"
+              << "  --confidence <c>    confidence level (default 0.95)\n"
+              << "  --threshold <pct>   minimum median change to flag, in percent (default 5)\n"
+              << "  --floor <ms>        minimum median change to flag when the baseline median is 0 (default 0.1)\n"
+              << "  --skip-first <n>    drop the first n rows of each run as warm-up (default 0)\n"
+              << "  --seed <s>          random seed for reproducible intervals (default 42)\n";
+}
+
+int main(int argc, char** argv) {
+
+    if(argc < 3){
+        print_usage();
+        return 2;
+    }
+
+    std::string baseline_path = argv[1];
+    std::string candidate_path = argv[2];
+    uint32_t resamples = 10000;
+    double confidence = 0.95;
+    double threshold_pct = 5.0;
+    double floor_ms = 0.1;
+    size_t skip_first = 0;
+    uint32_t seed = 42;
+
+    try {
+        for(int i = 3; i < argc; i++){
+            bool has_value = i + 1 < argc;
+            if(!strcmp(argv[i], "--resamples") && has_value){
+                resamples = (uint32_t) std::stoul(argv[++i]);
+            } else if(!strcmp(argv[i], "--confidence") && has_value){
+                confidence = std::stod(argv[++i]);
+            } else if(!strcmp(argv[i], "--threshold") && has_value){
+                threshold_pct = std::stod(argv[++i]);
+            } else if(!strcmp(argv[i], "--floor") && has_value){
+                floor_ms = std::stod(argv[++i]);
+            } else if(!strcmp(argv[i], "--skip-first") && has_value){
+                skip_first = std::stoul(argv[++i]);
+            } else if(!strcmp(argv[i], "--seed") && has_value){
+                seed = (uint32_t) std::stoul(argv[++i]);
+            } else {
+                print_usage();
+                return 2;
+            }
+        }
+
+        benchmark_table baseline;
+        benchmark_table candidate;
+        if(!read_benchmark_csv(baseline_path, baseline)){
+            std::cerr << "Could not read " << baseline_path << "\n";
+            return 2;
+        }
+        if(!read_benchmark_csv(candidate_path, candidate)){
+            std::cerr << "Could not read " << candidate_path << "\n";
+            return 2;
+        }
+
+        bool regression = false;
+        std::cout << std::fixed << std::setprecision(2);
+
+        for(size_t col = 0; col < baseline.columns.size(); col++){
+            const std::string& name = baseline.columns[col];
+            if(name == "Frame"){
+                continue;
+            }
+            int other = candidate.find_column(name);
+            if(other < 0){
+                std::cout << "Column \"" << name << "\" missing from candidate, skipping\n";
+                continue;
+            }
+
+            std::vector<double> base_values = baseline.values[col];
+            std::vector<double> cand_values = candidate.values[other];
+            base_values.erase(base_values.begin(), base_values.begin() + std::min(skip_first, base_values.size()));
+            cand_values.erase(cand_values.begin(), cand_values.begin() + std::min(skip_first, cand_values.size()));
+            if(base_values.empty() || cand_values.empty()){
+                std::cout << "Column \"" << name << "\" has no samples, skipping\n";
+                continue;
+            }
+
+            sample_summary base = summarize(base_values);
+            sample_summary cand = summarize(cand_values);
+            confidence_interval ci = bootstrap_median_difference(base_values, cand_values, resamples, confidence, seed);
+
+            // A stage that took no time in the baseline is judged on the absolute difference
+            bool timing = name.size() >= 4 && !name.compare(name.size() - 4, 4, "(ms)");
+            bool zero_base = base.median == 0;
+            double change_pct = zero_base ? 0 : 100.0 * (cand.median - base.median) / base.median;
+            bool worse = timing && ci.low > 0 && (zero_base ? ci.low > floor_ms : change_pct > threshold_pct);
+            bool better = timing && ci.high < 0 && (zero_base ? -ci.high > floor_ms : -change_pct > threshold_pct);
+            regression = regression || worse;
+
+            std::cout << name << "\n";
+            std::cout << "    baseline:  n=" << base.count << " mean=" << base.mean << " sd=" << base.stddev
+                      << " median=" << base.median << " p95=" << base.p95 << " p99=" << base.p99 << " max=" << base.max << "\n";
+            std::cout << "    candidate: n=" << cand.count << " mean=" << cand.mean << " sd=" << cand.stddev
+                      << " median=" << cand.median << " p95=" << cand.p95 << " p99=" << cand.p99 << " max=" << cand.max << "\n";
+            std::cout << "    median diff " << cand.median - base.median << (timing ? "ms (" : " (");
+            if(zero_base){
+                std::cout << "from 0";
+            } else {
+                std::cout << change_pct << "%";
+            }
+            std::cout << "), " << confidence * 100 << "% CI [" << ci.low << ", " << ci.high << "] -> "
+                      << (!timing ? "count, not judged" : worse ? "REGRESSION" : better ? "improvement" : "no significant change")
+                      << "\n";
+        }
+
+        return regression ? 1 : 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+}
@@ -0,0 +1,133 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "kd_tree.hpp"
+#include "point_cloud.hpp"
+
+// Times kd_tree build and batched queries on a saved cloud (no camera needed).
+// The cloud is resampled to each requested size: subsampled when smaller, and tiled with
+// millimeter jitter when larger, so the density and extent stay those of the capture.
+
+static void print_usage()
+{
+    std::cout << "usage: kd_tree_benchmark [cloud.ply] [options]\n"
+              << "  --sizes <n,n,...>   cloud sizes to test (default 100000,1000000)\n"
+              << "  --queries <n>       queries per batch (default 100000)\n"
+              << "  --k <n>             neighbors per knn query (default 8)\n"
+              << "  --radius <m>        radius query size in meters (default 0.02)\n"
+              << "  --threads <n>       worker threads, 0 for every core (default 0)\n"
+              << "  --repeat <n>        runs per measurement, the best is reported (default 3)\n";
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ms(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+static point_cloud resample(const point_cloud& source, size_t n, std::mt19937& rng)
+{
+    point_cloud cloud;
+    cloud.resize(n, false);
+    std::uniform_int_distribution<size_t> pick(0, source.size() - 1);
+    std::uniform_real_distribution<float> jitter(-0.001f, 0.001f);
+    for(size_t i = 0; i < n; i++){
+        size_t p = n <= source.size() ? pick(rng) : i % source.size();
+        bool copy = n > source.size() && i >= source.size();
+        cloud.x[i] = source.x[p] + (copy ? jitter(rng) : 0);
+        cloud.y[i] = source.y[p] + (copy ? jitter(rng) : 0);
+        cloud.z[i] = source.z[p] + (copy ? jitter(rng) : 0);
+    }
+    return cloud;
+}
+
+int main(int argc, char** argv) try {
+
+    std::string path = "pointcloud.ply";
+    std::vector<size_t> sizes = {100000, 1000000};
+    size_t num_queries = 100000;
+    uint32_t k = 8;
+    float radius = 0.02f;
+    unsigned num_threads = 0;
+    int repeat = 3;
+
+    for(int i = 1; i < argc; i++){
+        bool has_value = i + 1 < argc;
+        if(!strcmp(argv[i], "--sizes") && has_value){
+            sizes.clear();
+            std::stringstream list(argv[++i]);
+            std::string size;
+            while(std::getline(list, size, ',')){
+                sizes.push_back(std::stoul(size));
+            }
+        } else if(!strcmp(argv[i], "--queries") && has_value){
+            num_queries = std::stoul(argv[++i]);
+        } else if(!strcmp(argv[i], "--k") && has_value){
+            k = (uint32_t) std::stoul(argv[++i]);
+        } else if(!strcmp(argv[i], "--radius") && has_value){
+            radius = std::stof(argv[++i]);
+        } else if(!strcmp(argv[i], "--threads") && has_value){
+            num_threads = (unsigned) std::stoul(argv[++i]);
+        } else if(!strcmp(argv[i], "--repeat") && has_value){
+            repeat = std::max(1, std::stoi(argv[++i]));
+        } else if(argv[i][0] != '-'){
+            path = argv[i];
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    point_cloud source;
+    if(!read_ply(path, source) || source.size() == 0){
+        std::cerr << "Could not read " << path << "\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "Loaded " << source.size() << " points from " << path << "\n";
+    std::cout << std::fixed << std::setprecision(1);
+
+    std::mt19937 rng(42);
+    for(size_t n : sizes){
+        point_cloud cloud = resample(source, n, rng);
+        // Queries are cloud points, the usual case for normals / outlier removal
+        point_cloud queries = resample(cloud, std::min(num_queries, n), rng);
+
+        kd_tree tree;
+        double build_ms = 1e300, knn_ms = 1e300, radius_ms = 1e300;
+        std::vector<uint32_t> indices, offsets;
+        std::vector<float> dist2;
+        for(int r = 0; r < repeat; r++){
+            bench_clock::time_point start = bench_clock::now();
+            tree.build(cloud, num_threads);
+            build_ms = std::min(build_ms, elapsed_ms(start));
+
+            start = bench_clock::now();
+            tree.knn_batch(queries, k, indices, dist2, num_threads);
+            knn_ms = std::min(knn_ms, elapsed_ms(start));
+
+            start = bench_clock::now();
+            tree.radius_batch(queries, radius, offsets, indices, num_threads);
+            radius_ms = std::min(radius_ms, elapsed_ms(start));
+        }
+
+        double mean_found = (double) indices.size() / queries.size();
+        std::cout << n << " points: build " << build_ms << " ms, "
+                  << "knn (k=" << k << ") " << queries.size() / knn_ms * 1000 << " queries/s, "
+                  << "radius (" << std::setprecision(3) << radius << std::setprecision(1) << " m, " << mean_found << " found) "
+                  << queries.size() / radius_ms * 1000 << " queries/s\n";
+    }
+    return EXIT_SUCCESS;
+}
+catch (const std::exception& e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
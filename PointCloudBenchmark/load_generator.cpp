@@ -0,0 +1,294 @@
+#include "load_generator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <sys/resource.h>
+#include "replay_source.hpp"
+
+static rs2_intrinsics synthetic_intrinsics(int width, int height)
+{
+    rs2_intrinsics intrinsics;
+    intrinsics.width = width;
+    intrinsics.height = height;
+    intrinsics.ppx = width / 2.0f;
+    intrinsics.ppy = height / 2.0f;
+    intrinsics.fx = width * 0.9f;
+    intrinsics.fy = width * 0.9f;
+    intrinsics.model = RS2_DISTORTION_BROWN_CONRADY;
+    for(float& c : intrinsics.coeffs){
+        c = 0;
+    }
+    return intrinsics;
+}
+
+load_source make_synthetic_source(int width, int height, int fps, int num_frames)
+{
+    load_source source;
+    source.fps = fps;
+    source.depth = {synthetic_intrinsics(width, height), RS2_FORMAT_Z16, 2, {}};
+    source.color = {synthetic_intrinsics(width, height), RS2_FORMAT_RGB8, 3, {}};
+
+    for(int f = 0; f < num_frames; f++){
+        std::vector<uint8_t> depth(width * height * 2);
+        std::vector<uint8_t> color(width * height * 3);
+        uint16_t* z = reinterpret_cast<uint16_t*>(depth.data());
+        for(int y = 0; y < height; y++){
+            for(int x = 0; x < width; x++){
+                float meters = 1.0f + 0.5f * y / height + 0.05f * std::sin(x * 0.05f + f * 0.2f);
+                z[y * width + x] = (uint16_t) (meters / source.depth_units);
+
+                uint8_t* rgb = &color[(y * width + x) * 3];
+                rgb[0] = (uint8_t) (x * 255 / width);
+                rgb[1] = (uint8_t) (y * 255 / height);
+                rgb[2] = (uint8_t) (f * 8);
+            }
+        }
+        source.depth.frames.push_back(depth);
+        source.color.frames.push_back(color);
+    }
+    return source;
+}
+
+// Copies the frame tightly packed, stride padding is dropped
+static void append_frame(recorded_stream& stream, const rs2::video_frame& frame)
+{
+    stream.intrinsics = frame.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+    stream.format = frame.get_profile().format();
+    stream.bytes_per_pixel = frame.get_bytes_per_pixel();
+
+    int row_bytes = frame.get_width() * stream.bytes_per_pixel;
+    std::vector<uint8_t> data(row_bytes * frame.get_height());
+    const uint8_t* src = static_cast<const uint8_t*>(frame.get_data());
+    for(int y = 0; y < frame.get_height(); y++){
+        memcpy(&data[y * row_bytes], src + y * frame.get_stride_in_bytes(), row_bytes);
+    }
+    stream.frames.push_back(data);
+}
+
+load_source load_bag_source(const std::string& bag_file, int max_frames)
+{
+    load_source source;
+
+    rs2::pipeline p;
+    rs2::config cfg;
+    replay_source replay(bag_file, replay_pacing::unpaced, false);
+    replay.configure(cfg);
+    cfg.enable_stream(RS2_STREAM_DEPTH);
+    cfg.enable_stream(RS2_STREAM_COLOR);
+    rs2::pipeline_profile profile = p.start(cfg);
+    replay.on_start(profile);
+
+    source.fps = profile.get_stream(RS2_STREAM_DEPTH).fps();
+    source.depth_units = profile.get_device().first<rs2::depth_sensor>().get_depth_scale();
+
+    rs2::frameset frames;
+    while((int) source.depth.frames.size() < max_frames && replay.next(p, frames)){
+        rs2::depth_frame depth = frames.get_depth_frame();
+        rs2::video_frame color = frames.get_color_frame();
+        if(!depth || !color){
+            continue;
+        }
+        append_frame(source.depth, depth);
+        append_frame(source.color, color);
+    }
+    p.stop();
+
+    std::cout << "Loaded " << source.depth.frames.size() << " framesets from " << bag_file << "\n";
+    return source;
+}
+
+// One software device plus the pipeline consuming it. The producer thread injects frames at the
+// source frame rate with this device's own clock; the consumer thread syncs and extracts point clouds.
+class virtual_camera {
+public:
+    virtual_camera(const load_source& source, int index, int num_devices)
+            : source(source), index(index), num_devices(num_devices), depth_sensor(dev.add_sensor("Depth")),
+              color_sensor(dev.add_sensor("Color")), sync(1)
+    {
+        const rs2_intrinsics& di = source.depth.intrinsics;
+        const rs2_intrinsics& ci = source.color.intrinsics;
+        depth_stream = depth_sensor.add_video_stream({RS2_STREAM_DEPTH, 0, 0, di.width, di.height, source.fps,
+                                                      source.depth.bytes_per_pixel, source.depth.format, di});
+        color_stream = color_sensor.add_video_stream({RS2_STREAM_COLOR, 0, 1, ci.width, ci.height, source.fps,
+                                                      source.color.bytes_per_pixel, source.color.format, ci});
+        depth_sensor.add_read_only_option(RS2_OPTION_DEPTH_UNITS, source.depth_units);
+        depth_stream.register_extrinsics_to(color_stream, {{1, 0, 0, 0, 1, 0, 0, 0, 1}, {0, 0, 0}});
+        dev.create_matcher(RS2_MATCHER_DLR_C);
+
+        depth_sensor.open(depth_stream);
+        color_sensor.open(color_stream);
+        depth_sensor.start(sync);
+        color_sensor.start(sync);
+    }
+
+    ~virtual_camera()
+    {
+        stop();
+        depth_sensor.stop();
+        color_sensor.stop();
+        depth_sensor.close();
+        color_sensor.close();
+    }
+
+    void start()
+    {
+        running = true;
+        producer = std::thread(&virtual_camera::produce, this);
+        consumer = std::thread(&virtual_camera::consume, this);
+    }
+
+    void stop()
+    {
+        running = false;
+        if(producer.joinable()) producer.join();
+        if(consumer.joinable()) consumer.join();
+    }
+
+    uint64_t frames_sent() const { return sent; }
+    uint64_t frames_processed() const { return processed; }
+
+private:
+    void produce()
+    {
+        std::chrono::duration<double> period(1.0 / source.fps);
+        std::chrono::steady_clock::time_point next_tick = std::chrono::steady_clock::now();
+
+        // Spread the devices' clocks evenly over one frame period so no two devices share timestamps
+        double timestamp_ms = index * 1000.0 / (source.fps * num_devices);
+        int frame_number = 0;
+
+        // The source buffers outlive the sensors, so the frames don't own their pixels
+        auto no_delete = [](void*) {};
+        while(running){
+            size_t i = frame_number % source.depth.frames.size();
+            const recorded_stream& d = source.depth;
+            const recorded_stream& c = source.color;
+            depth_sensor.on_video_frame({(void*) d.frames[i].data(), no_delete, d.intrinsics.width * d.bytes_per_pixel,
+                                         d.bytes_per_pixel, timestamp_ms, RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK,
+                                         frame_number, depth_stream.get()});
+            color_sensor.on_video_frame({(void*) c.frames[i].data(), no_delete, c.intrinsics.width * c.bytes_per_pixel,
+                                         c.bytes_per_pixel, timestamp_ms, RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK,
+                                         frame_number, color_stream.get()});
+            sent++;
+            frame_number++;
+            timestamp_ms += 1000.0 / source.fps;
+
+            next_tick += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+            std::this_thread::sleep_until(next_tick);
+        }
+    }
+
+    void consume()
+    {
+        rs2::pointcloud pc;
+        rs2::points points;
+        rs2::frameset frames;
+        while(running){
+            if(!sync.try_wait_for_frames(&frames, 100)){
+                continue;
+            }
+            rs2::frame depth = frames.first_or_default(RS2_STREAM_DEPTH);
+            rs2::frame color = frames.first_or_default(RS2_STREAM_COLOR);
+            if(!depth || !color){
+                continue;
+            }
+            points = pc.calculate(depth);
+            pc.map_to(color);
+            processed++;
+        }
+    }
+
+    const load_source& source;
+    int index;
+    int num_devices;
+    rs2::software_device dev;
+    rs2::software_sensor depth_sensor;
+    rs2::software_sensor color_sensor;
+    rs2::stream_profile depth_stream;
+    rs2::stream_profile color_stream;
+    rs2::syncer sync;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> processed{0};
+    std::thread producer;
+    std::thread consumer;
+};
+
+static double cpu_seconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+load_step_results run_load_step(const load_source& source, int num_devices, double duration_s)
+{
+    std::vector<std::unique_ptr<virtual_camera>> cameras;
+    for(int i = 0; i < num_devices; i++){
+        cameras.push_back(std::unique_ptr<virtual_camera>(new virtual_camera(source, i, num_devices)));
+    }
+
+    double cpu_start = cpu_seconds();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(auto& camera : cameras){
+        camera->start();
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration_s));
+    for(auto& camera : cameras){
+        camera->stop();
+    }
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu_s = cpu_seconds() - cpu_start;
+
+    load_step_results results;
+    results.num_devices = num_devices;
+    uint64_t total_sent = 0;
+    uint64_t total_processed = 0;
+    for(auto& camera : cameras){
+        device_load_stats stats;
+        stats.frames_sent = camera->frames_sent();
+        stats.frames_processed = camera->frames_processed();
+        stats.processed_fps = stats.frames_processed / wall_s;
+        results.devices.push_back(stats);
+        total_sent += stats.frames_sent;
+        total_processed += stats.frames_processed;
+    }
+    results.aggregate_fps = total_processed / wall_s;
+    results.cpu_percent = 100.0 * cpu_s / wall_s;
+    results.drop_rate = total_sent > 0 ? 1.0 - (double) total_processed / total_sent : 0;
+    return results;
+}
+
+void run_load_generator(const load_source& source, int max_devices, double duration_s, const std::string& results_path)
+{
+    std::ofstream load_results(results_path);
+    load_results << "Devices,Aggregate FPS,Min Device FPS,Max Device FPS,CPU (%),Drop Rate (%)\n";
+
+    for(int n = 1; n <= max_devices; n++){
+        load_step_results step = run_load_step(source, n, duration_s);
+
+        double min_fps = step.devices.front().processed_fps;
+        double max_fps = min_fps;
+        for(size_t i = 0; i < step.devices.size(); i++){
+            const device_load_stats& d = step.devices[i];
+            min_fps = std::min(min_fps, d.processed_fps);
+            max_fps = std::max(max_fps, d.processed_fps);
+            std::cout << "  device " << i << ": sent " << d.frames_sent << ", processed " << d.frames_processed
+                      << " (" << d.processed_fps << " FPS)\n";
+        }
+        std::cout << n << " devices: " << step.aggregate_fps << " FPS aggregate, CPU " << step.cpu_percent
+                  << "%, dropped " << 100 * step.drop_rate << "%\n";
+
+        load_results << n << "," << step.aggregate_fps << "," << min_fps << "," << max_fps << ","
+                     << step.cpu_percent << "," << 100 * step.drop_rate << "\n";
+        load_results.flush();
+    }
+    std::cout << "Saved Load Results to " << results_path << "\n";
+}
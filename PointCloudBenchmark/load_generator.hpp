@@ -0,0 +1,51 @@
+#ifndef LOAD_GENERATOR_HPP
+#define LOAD_GENERATOR_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <librealsense2/rs.hpp>
+
+// Frames of one stream kept in memory so they can be injected into any number of virtual devices
+struct recorded_stream {
+    rs2_intrinsics intrinsics;
+    rs2_format format;
+    int bytes_per_pixel;
+    std::vector<std::vector<uint8_t>> frames;
+};
+
+struct load_source {
+    recorded_stream depth;
+    recorded_stream color;
+    float depth_units = 0.001f;
+    int fps = 30;
+};
+
+// Tilted plane with ripples and a color gradient, no camera or recording needed
+load_source make_synthetic_source(int width, int height, int fps, int num_frames);
+
+// Copies up to max_frames framesets out of a .bag recording
+load_source load_bag_source(const std::string& bag_file, int max_frames);
+
+struct device_load_stats {
+    uint64_t frames_sent = 0;
+    uint64_t frames_processed = 0;
+    double processed_fps = 0;
+};
+
+struct load_step_results {
+    int num_devices = 0;
+    std::vector<device_load_stats> devices;
+    double aggregate_fps = 0;
+    double cpu_percent = 0; // of one core, so 4 busy cores read 400
+    double drop_rate = 0;
+};
+
+// Runs num_devices software devices fed from the source, each with its own timestamps and its own
+// processing pipeline (syncer + pointcloud) on a dedicated thread, for duration_s seconds.
+load_step_results run_load_step(const load_source& source, int num_devices, double duration_s);
+
+// Steps from 1 to max_devices and writes one row per device count
+void run_load_generator(const load_source& source, int max_devices, double duration_s, const std::string& results_path);
+
+#endif //LOAD_GENERATOR_HPP
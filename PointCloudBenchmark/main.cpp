@@ -1,8 +1,10 @@
 #include <iostream>
-#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <librealsense2/rs.hpp>
-#include <opencv/cv.hpp>
-#include <fstream>
+#include "benchmark_runner.hpp"
+#include "load_generator.hpp"
+#include "sweep.hpp"
 //#include <algorithm>
 //#include "../../librealsense/examples/example.hpp"          // Include short list of convenience functions for rendering
 
@@ -12,126 +14,153 @@ inline bool prompt_yes_no(const std::string& prompt_msg);
 inline uint32_t get_user_selection(const std::string& prompt_msg);
 
 
-// TODO: command line arguments, namespace, save extract time to csv too
-
-int main() {
+static void print_usage()
+{
+    std::cout << "usage: run_benchmark                 interactive single run\n"
+              << "       run_benchmark --sweep <file>  run every config in a sweep file\n"
+              << "       run_benchmark --multicam <n>  feed 1..n virtual devices and report scaling\n"
+              << "  --bag <file>     play back a .bag recording instead of the camera\n"
+              << "  --replay <mode>  realtime (default), fast (as fast as frames are processed)\n"
+              << "                   or paced (every frame, spaced like the recording)\n"
+              << "  --duration <s>   seconds per device count in --multicam (default 10)\n"
+              << "  --log <file>     write per-frame timings to a file instead of stdout\n"
+              << "  --log-binary     write --log as binary records (see async_logger.hpp)\n"
+              << "  --log-rate <n>   print at most n timing lines per second\n"
+              << "  --filters <list> depth post-processing before extraction, e.g. decimation:2,spatial,temporal,holes\n"
+              << "  --edges <mode>[:<ms>]  mask or snap depth at color edges, within a per-frame budget (aligns depth to color)\n"
+              << "  --compact <near>:<far>  extract only valid points within the range (meters)\n"
+              << "  --roi <r>        extract only a region: area fraction (0.25) or <w>x<h>+<x>+<y> in depth pixels\n"
+              << "  --box <b>        extract only inside a box: cx,cy,cz,hx,hy,hz[,roll,pitch,yaw] (m, degrees)\n"
+              << "  --flying <r>[:<m>]  drop pixels with a depth step to a neighbor above m + r * depth (default m 0.01)\n"
+              << "  --outliers <f>   statistical[:k[:std]] or radius[:m[:n]] outlier removal (defaults 8:1.0, 0.02:4)\n"
+              << "  --outlier-budget <ms>  stop testing points once a frame's outlier pass has run this long\n"
+              << "  --normals <px>   estimate normals on the pixel grid with this window radius, exported as nx/ny/nz\n"
+              << "  --planes <n>[:<m>] remove up to n dominant planes, inlier distance in meters (default 0.02)\n"
+              << "  --clusters <m>[:<n>] cluster with this neighbor distance, clusters under n points dropped (default 50)\n"
+              << "  --voxel <m>      voxel-grid downsample each cloud before export, voxel size in meters\n"
+              << "  --threads <n>    threads for processing stages (default: every core)\n"
+              << "  --output <csv>   results table (default ../sweep_results.csv or ../load_results.csv)\n";
+}
 
-    bool save_img_to_disk = prompt_yes_no("Save Images to Disk? ");
-    uint32_t num_frames = get_user_selection("How Many Frames to Grab? (Recommended: 120): ");
-    bool save_benchmark_to_disk = prompt_yes_no("Save Benchmark to Disk?");
-    //TODO: Choose resolution / Output for average benchmark ms per resolution
-
-    // Store benchmark numbers to csv (We don't save the very first one)
-    long save_ms;
-    long frame_receipts_ms;
-    long frameset_wait_for_receipts_ms;
-    long time_taken_to_save[num_frames-1] = {};
-    long time_between_frame_receipts[num_frames-1] = {};
-    long time_taken_to_receive[num_frames-1] = {};
-
-    // Create Pipeline
-    rs2::pipeline p;
-
-    // Create Pointcloud
-    rs2::pointcloud pc;
-    rs2::points points;
-
-    //Create a configuration for configuring the pipeline with a non default profile
-    rs2::config cv_config;
-
-    //Add desired streams to configuration
-    //cfg.enable_stream(RS2_STREAM_COLOR, 640, 480, RS2_FORMAT_BGR8, 30);
-    //cv_config.enable_stream(RS2_STREAM_COLOR, 1280, 720, RS2_FORMAT_RGB8, 30);
-    cv_config.enable_stream(RS2_STREAM_COLOR, 1920, 1080, RS2_FORMAT_RGB8, 30);
-    cv_config.enable_stream(RS2_STREAM_DEPTH, 1280, 720, RS2_FORMAT_Z16, 30);
-    p.start(cv_config); // pipeline started (ignore editor error)
-
-    int fps_counter = 0; // for counting FPS
-    int frame_counter = 0; // for counting how many frames until # of frames user has requested
-
-    std::chrono::system_clock::time_point prev_time = std::chrono::system_clock::now(); // Initialize time of previous frame
-    std::chrono::system_clock::time_point fps_time = std::chrono::system_clock::now(); // Initialize time of previous frame
-
-
-    while(frame_counter < num_frames){
-        std::chrono::system_clock::time_point start_waiting_for_frames = std::chrono::system_clock::now();
-        rs2::frameset frames = p.wait_for_frames();
-
-        std::chrono::system_clock::time_point receive_time = std::chrono::system_clock::now();
-        frame_receipts_ms = std::chrono::duration_cast<std::chrono::milliseconds>(receive_time - prev_time).count();
-        frameset_wait_for_receipts_ms = std::chrono::duration_cast<std::chrono::milliseconds>(receive_time - start_waiting_for_frames).count();
-        std::cout << "Time Taken to Receive:" << frameset_wait_for_receipts_ms << "ms \n";
-        std::cout << "Time Between Two Frame Receipts: " << frame_receipts_ms << "ms \n";
-        //std::cout << "Number of Frames: " << frames.size() << " frames \n"
-
-        if(frame_counter != 0){
-            time_between_frame_receipts[frame_counter-1] = frame_receipts_ms;
-            time_taken_to_receive[frame_counter-1] = frameset_wait_for_receipts_ms;
+// TODO: namespace
+
+int main(int argc, char** argv) try {
+
+    std::string sweep_file;
+    std::string output;
+    int multicam_devices = 0;
+    double multicam_duration_s = 10;
+    benchmark_config config;
+    for(int i = 1; i < argc; i++){
+        bool has_value = i + 1 < argc;
+        if(!strcmp(argv[i], "--sweep") && has_value){
+            sweep_file = argv[++i];
+        } else if(!strcmp(argv[i], "--bag") && has_value){
+            config.bag_file = argv[++i];
+        } else if(!strcmp(argv[i], "--replay") && has_value && parse_replay_pacing(argv[i+1], config.replay)){
+            i++;
+        } else if(!strcmp(argv[i], "--multicam") && has_value){
+            multicam_devices = std::stoi(argv[++i]);
+        } else if(!strcmp(argv[i], "--duration") && has_value){
+            multicam_duration_s = std::stod(argv[++i]);
+        } else if(!strcmp(argv[i], "--log") && has_value){
+            config.log_options.path = argv[++i];
+        } else if(!strcmp(argv[i], "--log-binary")){
+            config.log_options.mode = async_logger::output_mode::binary;
+        } else if(!strcmp(argv[i], "--log-rate") && has_value){
+            config.log_options.max_lines_per_second = (uint32_t) std::stoul(argv[++i]);
+        } else if(!strcmp(argv[i], "--compact") && has_value
+                  && sscanf(argv[i+1], "%f:%f", &config.near_m, &config.far_m) == 2){
+            config.compact = true;
+            i++;
+        } else if(!strcmp(argv[i], "--edges") && has_value && parse_edge_cleaning(argv[i+1], config.edge_cleaning)){
+            config.clean_edges = true;
+            config.align_to_color = true;
+            i++;
+        } else if(!strcmp(argv[i], "--filters") && has_value){
+            config.depth_filters = argv[++i];
+        } else if(!strcmp(argv[i], "--roi") && has_value && parse_roi(argv[i+1], config)){
+            i++;
+        } else if(!strcmp(argv[i], "--box") && has_value && parse_box(argv[i+1], config.box)){
+            i++;
+        } else if(!strcmp(argv[i], "--flying") && has_value
+                  && sscanf(argv[i+1], "%f:%f", &config.flying_ratio, &config.flying_min_m) >= 1){
+            i++;
+        } else if(!strcmp(argv[i], "--outliers") && has_value && parse_outlier_params(argv[i+1], config.outliers)){
+            config.remove_outliers = true;
+            i++;
+        } else if(!strcmp(argv[i], "--outlier-budget") && has_value){
+            config.outliers.budget_ms = std::stod(argv[++i]);
+        } else if(!strcmp(argv[i], "--normals") && has_value){
+            config.normal_radius = std::stoi(argv[++i]);
+        } else if(!strcmp(argv[i], "--planes") && has_value
+                  && sscanf(argv[i+1], "%d:%f", &config.max_planes, &config.plane_distance) >= 1){
+            i++;
+        } else if(!strcmp(argv[i], "--clusters") && has_value
+                  && sscanf(argv[i+1], "%f:%zu", &config.cluster_tolerance, &config.cluster_min_points) >= 1){
+            i++;
+        } else if(!strcmp(argv[i], "--voxel") && has_value){
+            config.voxel_size = std::stof(argv[++i]);
+        } else if(!strcmp(argv[i], "--threads") && has_value){
+            config.num_threads = (unsigned) std::stoul(argv[++i]);
+        } else if(!strcmp(argv[i], "--output") && has_value){
+            output = argv[++i];
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
         }
+    }
 
-        prev_time = receive_time;
-
-
-        auto depth = frames.get_depth_frame();
-        auto color = frames.get_color_frame();
-
-        // Extract point cloud
-        points = pc.calculate(depth);
-        pc.map_to(color);
-
-        std::chrono::system_clock::time_point extracted_time = std::chrono::system_clock::now();
-        std::cout << "Time taken to extract:" << std::chrono::duration_cast<std::chrono::milliseconds>(extracted_time - receive_time).count() << "ms \n";
+    if(config.log_options.mode == async_logger::output_mode::binary && config.log_options.path.empty()){
+        std::cerr << "--log-binary needs --log <file>\n";
+        return EXIT_FAILURE;
+    }
 
-        // Print out FPS
-        if(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - fps_time).count() == 1){
-            std::cout << "FPS: " << fps_counter << " -------------------------------------------------------\n";
-            fps_counter = 0;
-            fps_time = std::chrono::system_clock::now();
+    if(!sweep_file.empty()){
+        sweep_matrix matrix;
+        if(!read_sweep_file(sweep_file, matrix)){
+            return EXIT_FAILURE;
         }
+        run_sweep(expand_sweep(matrix, config), output.empty() ? "../sweep_results.csv" : output);
+        return EXIT_SUCCESS;
+    }
 
-        if(save_img_to_disk){
-            std::chrono::system_clock::time_point start_time = std::chrono::system_clock::now();
-            points.export_to_ply("pointcloud.ply", color);
-
-            std::chrono::system_clock::time_point save_time = std::chrono::system_clock::now();
-            save_ms = std::chrono::duration_cast<std::chrono::milliseconds>(save_time - start_time).count();
-            std::cout << "Time taken to save:" << save_ms << "ms \n";
-
-            if(frame_counter != 0){
-                time_taken_to_save[frame_counter-1] = save_ms;
-            }
+    if(multicam_devices > 0){
+        // Recorded frames are looped, synthetic ones match the default depth profile
+        load_source source = config.bag_file.empty() ? make_synthetic_source(1280, 720, 30, 30)
+                                                     : load_bag_source(config.bag_file, 90);
+        if(source.depth.frames.empty()){
+            std::cerr << "No frames to replay\n";
+            return EXIT_FAILURE;
         }
+        run_load_generator(source, multicam_devices, multicam_duration_s, output.empty() ? "../load_results.csv" : output);
+        return EXIT_SUCCESS;
+    }
 
-        fps_counter++;
-        frame_counter ++;
-
-        if(save_benchmark_to_disk && frame_counter == num_frames){
-
-            //TODO: Add extract time
-            std::ofstream benchmark_results;
-            benchmark_results.open("../benchmark_results. csv");
-            benchmark_results << "Frame, Time Taken to Save (ms),Time Between Frame Receipts (ms),Time Taken to Receive (ms)\n";
-            for(int i=0; i<num_frames-1; i++){
-                benchmark_results << i+1 << "," << time_taken_to_save[i] << "," << time_between_frame_receipts[i] << "," << time_taken_to_receive[i] << "\n";
-            }
-            benchmark_results.close();
-            std::cout << "Saved Benchmark Results to CSV! \n";
-        }
+    config.save_to_disk = prompt_yes_no("Save Images to Disk? ");
+    config.num_frames = get_user_selection(config.bag_file.empty() ? "How Many Frames to Grab? (Recommended: 120): "
+                                                            : "How Many Frames to Grab? (0 plays the whole recording): ");
+    bool save_benchmark_to_disk = prompt_yes_no("Save Benchmark to Disk?");
+    //TODO: Choose resolution / Output for average benchmark ms per resolution (use --sweep for now)
 
+    benchmark_results results = run_benchmark_config(config);
 
+    if(save_benchmark_to_disk){
+        write_benchmark_csv("../benchmark_results. csv", results);
+        std::cout << "Saved Benchmark Results to CSV! \n";
     }
     return EXIT_SUCCESS;
 }
-//catch (const rs2::error & e)
-//{
-//    std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
-//    return EXIT_FAILURE;
-//}
-//catch (const std::exception & e)
-//{
-//    std::cerr << e.what() << std::endl;
-//    return EXIT_FAILURE;
-//}
+catch (const rs2::error & e)
+{
+    std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
+catch (const std::exception & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
 
 
 inline bool prompt_yes_no(const std::string& prompt_msg)
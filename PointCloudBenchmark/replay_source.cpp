@@ -0,0 +1,74 @@
+#include "replay_source.hpp"
+
+#include <thread>
+
+bool parse_replay_pacing(const std::string& text, replay_pacing& pacing)
+{
+    if(text == "realtime"){
+        pacing = replay_pacing::real_time;
+    } else if(text == "fast"){
+        pacing = replay_pacing::unpaced;
+    } else if(text == "paced"){
+        pacing = replay_pacing::paced;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* to_string(replay_pacing pacing)
+{
+    switch(pacing){
+        case replay_pacing::unpaced: return "fast";
+        case replay_pacing::paced: return "paced";
+        default: return "realtime";
+    }
+}
+
+replay_source::replay_source(const std::string& bag_file, replay_pacing pacing, bool repeat)
+        : bag_file(bag_file), pacing(pacing), repeat(repeat)
+{
+}
+
+void replay_source::configure(rs2::config& cfg) const
+{
+    cfg.enable_device_from_file(bag_file, repeat);
+}
+
+void replay_source::on_start(const rs2::pipeline_profile& profile)
+{
+    device = profile.get_device();
+    if(pacing != replay_pacing::real_time){
+        // Playback now blocks on us instead of dropping frames, so every run sees the same frames
+        device.as<rs2::playback>().set_real_time(false);
+    }
+    has_reference = false;
+}
+
+bool replay_source::next(rs2::pipeline& p, rs2::frameset& frames)
+{
+    // A short timeout is enough, playback either has a frame ready or has reached the end
+    while(!p.try_wait_for_frames(&frames, 1000)){
+        if(device.as<rs2::playback>().current_status() == RS2_PLAYBACK_STATUS_STOPPED){
+            return false;
+        }
+    }
+
+    if(pacing == replay_pacing::paced){
+        double timestamp_ms = frames.get_timestamp();
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        // Re-anchor on the first frame and whenever a repeating recording wraps around
+        if(!has_reference || timestamp_ms < reference_timestamp_ms){
+            has_reference = true;
+            reference_timestamp_ms = timestamp_ms;
+            reference_time = now;
+        }
+        std::chrono::steady_clock::time_point due = reference_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::milli>(timestamp_ms - reference_timestamp_ms));
+        if(due > now){
+            std::this_thread::sleep_until(due);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef REPLAY_SOURCE_HPP
+#define REPLAY_SOURCE_HPP
+
+#include <chrono>
+#include <string>
+#include <librealsense2/rs.hpp>
+
+enum class replay_pacing {
+    real_time, // librealsense default, frames are dropped if we fall behind
+    unpaced,   // set_real_time(false): every frame is delivered as fast as we consume it
+    paced      // every frame is delivered, spaced like the original timestamps
+};
+
+bool parse_replay_pacing(const std::string& text, replay_pacing& pacing);
+const char* to_string(replay_pacing pacing);
+
+// Frame source that plays back a .bag recording through the pipeline.
+// Without repeat, next() returns false once the recording is exhausted.
+class replay_source {
+public:
+    replay_source(const std::string& bag_file, replay_pacing pacing, bool repeat);
+
+    // Must be called on the config before the pipeline starts
+    void configure(rs2::config& cfg) const;
+
+    // Must be called with the profile returned by pipeline::start
+    void on_start(const rs2::pipeline_profile& profile);
+
+    bool next(rs2::pipeline& p, rs2::frameset& frames);
+
+private:
+    std::string bag_file;
+    replay_pacing pacing;
+    bool repeat;
+    rs2::device device;
+    bool has_reference = false;
+    double reference_timestamp_ms = 0;
+    std::chrono::steady_clock::time_point reference_time;
+};
+
+#endif //REPLAY_SOURCE_HPP
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "euclidean_clustering.hpp"
+#include "plane_segmentation.hpp"
+#include "point_cloud.hpp"
+
+// Times the segmentation stages (planes, then clusters on the rest) on a saved cloud
+// (no camera needed), best of --repeat runs.
+
+static void print_usage()
+{
+    std::cout << "usage: segmentation_benchmark [cloud.ply] [options]\n"
+              << "  --planes <n>        planes to extract (default 3)\n"
+              << "  --distance <m>      plane inlier distance (default 0.02)\n"
+              << "  --tolerance <m>     cluster neighbor distance, 0 skips clustering (default 0.02)\n"
+              << "  --min-points <n>    smallest cluster kept (default 50)\n"
+              << "  --threads <n>       worker threads, 0 for every core (default 0)\n"
+              << "  --repeat <n>        runs per measurement, the best is reported (default 5)\n"
+              << "  --output <ply>      write the cloud with the planes removed, and its clusters to <ply>.clusters.csv\n";
+}
+
+int main(int argc, char** argv) try {
+
+    std::string path = "pointcloud.ply";
+    std::string output;
+    plane_params planes;
+    cluster_params clusters;
+    int repeat = 5;
+
+    for(int i = 1; i < argc; i++){
+        bool has_value = i + 1 < argc;
+        if(!strcmp(argv[i], "--planes") && has_value){
+            planes.max_planes = std::stoi(argv[++i]);
+        } else if(!strcmp(argv[i], "--distance") && has_value){
+            planes.distance = std::stof(argv[++i]);
+        } else if(!strcmp(argv[i], "--threads") && has_value){
+            planes.num_threads = (unsigned) std::stoul(argv[++i]);
+            clusters.num_threads = planes.num_threads;
+        } else if(!strcmp(argv[i], "--tolerance") && has_value){
+            clusters.tolerance = std::stof(argv[++i]);
+        } else if(!strcmp(argv[i], "--min-points") && has_value){
+            clusters.min_points = std::stoul(argv[++i]);
+        } else if(!strcmp(argv[i], "--repeat") && has_value){
+            repeat = std::max(1, std::stoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--output") && has_value){
+            output = argv[++i];
+        } else if(argv[i][0] != '-'){
+            path = argv[i];
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    point_cloud cloud;
+    if(!read_ply(path, cloud) || cloud.size() == 0){
+        std::cerr << "Could not read " << path << "\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "Loaded " << cloud.size() << " points from " << path << "\n";
+
+    plane_segmentation segmentation;
+    double best_ms = 1e300;
+    for(int r = 0; r < repeat; r++){
+        segmentation = segment_planes(cloud, planes);
+        best_ms = std::min(best_ms, segmentation.ms);
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    for(size_t p = 0; p < segmentation.planes.size(); p++){
+        const plane_model& m = segmentation.planes[p];
+        std::cout << "Plane " << p << ": " << m.a << "x + " << m.b << "y + " << m.c << "z + " << m.d
+                  << " = 0, " << m.inliers << " points\n";
+    }
+    std::cout << std::setprecision(1) << "Planes: " << best_ms << " ms, " << segmentation.hypotheses << " hypotheses\n";
+
+    // Saved clouds have no pixel indices, so this times the voxel-adjacency path
+    point_cloud objects = remove_planes(cloud, segmentation);
+    if(clusters.tolerance > 0){
+        clustering result;
+        best_ms = 1e300;
+        for(int r = 0; r < repeat; r++){
+            result = cluster_points(objects, clusters);
+            best_ms = std::min(best_ms, result.ms);
+        }
+        std::cout << "Clusters: " << best_ms << " ms, " << result.clusters.size() << " clusters";
+        if(!result.clusters.empty()){
+            std::cout << ", largest " << result.clusters[0].indices.size() << " points";
+        }
+        std::cout << "\n";
+        if(!output.empty()){
+            write_clusters(output + ".clusters.csv", result);
+        }
+    }
+
+    if(!output.empty()){
+        write_ply(output, objects);
+    }
+    return EXIT_SUCCESS;
+}
+catch (const std::exception& e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,189 @@
+#include "sweep.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "benchmark_stats.hpp"
+
+static bool parse_toggle(const std::string& value, bool& toggle)
+{
+    if(value == "on" || value == "1" || value == "y"){
+        toggle = true;
+        return true;
+    }
+    if(value == "off" || value == "0" || value == "n"){
+        toggle = false;
+        return true;
+    }
+    return false;
+}
+
+bool read_sweep_file(const std::string& path, sweep_matrix& matrix)
+{
+    std::ifstream in(path);
+    if(!in.is_open()){
+        std::cerr << "Could not open sweep file " << path << "\n";
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while(std::getline(in, line)){
+        line_number++;
+        line = line.substr(0, line.find('#'));
+        std::stringstream tokens(line);
+        std::string key;
+        if(!(tokens >> key)){
+            continue;
+        }
+
+        std::string value;
+        bool ok = true;
+        while(ok && tokens >> value){
+            if(key == "color" || key == "depth"){
+                stream_profile profile;
+                ok = parse_stream_profile(value, profile);
+                (key == "color" ? matrix.color : matrix.depth).push_back(profile);
+            } else if(key == "align" || key == "save"){
+                bool toggle;
+                ok = parse_toggle(value, toggle);
+                (key == "align" ? matrix.align_to_color : matrix.save_to_disk).push_back(toggle);
+            } else if(key == "roi"){
+                benchmark_config check;
+                ok = parse_roi(value, check);
+                matrix.roi.push_back(value);
+            } else if(key == "frames"){
+                matrix.num_frames = (uint32_t) std::stoul(value);
+            } else if(key == "duration"){
+                matrix.duration_s = std::stod(value);
+            } else {
+                ok = false;
+            }
+        }
+        if(!ok){
+            std::cerr << path << ":" << line_number << ": can't parse \"" << value << "\" for " << key << "\n";
+            return false;
+        }
+    }
+
+    // Anything not swept keeps the run_benchmark default
+    benchmark_config defaults;
+    if(matrix.color.empty()) matrix.color.push_back(defaults.color);
+    if(matrix.depth.empty()) matrix.depth.push_back(defaults.depth);
+    if(matrix.align_to_color.empty()) matrix.align_to_color.push_back(defaults.align_to_color);
+    if(matrix.save_to_disk.empty()) matrix.save_to_disk.push_back(defaults.save_to_disk);
+    return true;
+}
+
+std::vector<benchmark_config> expand_sweep(const sweep_matrix& matrix, const benchmark_config& base)
+{
+    std::vector<benchmark_config> configs;
+    for(const stream_profile& color : matrix.color){
+        for(const stream_profile& depth : matrix.depth){
+            for(bool align_to_color : matrix.align_to_color){
+                for(bool save_to_disk : matrix.save_to_disk){
+                    benchmark_config config = base;
+                    config.color = color;
+                    config.depth = depth;
+                    config.align_to_color = align_to_color;
+                    config.save_to_disk = save_to_disk;
+                    config.num_frames = matrix.num_frames;
+                    config.duration_s = matrix.duration_s;
+                    if(matrix.roi.empty()){
+                        configs.push_back(config);
+                    }
+                    for(const std::string& roi : matrix.roi){
+                        parse_roi(roi, config);
+                        configs.push_back(config);
+                    }
+                }
+            }
+        }
+    }
+    return configs;
+}
+
+static void write_percentiles(std::ofstream& out, const std::vector<double>& samples)
+{
+    sample_summary s = summarize(samples);
+    out << "," << s.mean << "," << s.median << "," << s.p95 << "," << s.p99;
+}
+
+static void write_header(std::ofstream& out, const std::vector<std::string>& stages)
+{
+    out << "Color,Depth,Align,Save,ROI,Frames,Elapsed (s),FPS";
+    std::vector<std::string> columns = {"Receive (ms)", "Between Receipts (ms)", "Extract (ms)", "Save (ms)"};
+    columns.insert(columns.end(), stages.begin(), stages.end());
+    for(const std::string& column : columns){
+        out << "," << column << " mean," << column << " p50," << column << " p95," << column << " p99";
+    }
+    out << "\n";
+}
+
+void run_sweep(const std::vector<benchmark_config>& configs, const std::string& results_path)
+{
+    std::ofstream sweep_results(results_path);
+    if(configs.empty()){
+        return;
+    }
+
+    // Configs can record different stages (align, ROI extraction), so every row has the union of
+    // them and leaves the ones its config didn't record empty
+    std::vector<std::string> stages;
+    for(const benchmark_config& config : configs){
+        for(const std::string& column : stage_columns(config)){
+            if(std::find(stages.begin(), stages.end(), column) == stages.end()){
+                stages.push_back(column);
+            }
+        }
+    }
+    write_header(sweep_results, stages);
+
+    // One logger for the whole sweep: a logger per config would truncate the log file each time.
+    // Every config starts with a marker record carrying its number.
+    async_logger log(configs.front().log_options);
+    const uint16_t log_config = log.event("Sweep config: ");
+
+    for(size_t i = 0; i < configs.size(); i++){
+        const benchmark_config& config = configs[i];
+        std::cout << "Sweep " << i+1 << "/" << configs.size() << ": color " << to_string(config.color)
+                  << ", depth " << to_string(config.depth) << ", align " << (config.align_to_color ? "on" : "off")
+                  << ", save " << (config.save_to_disk ? "on" : "off") << ", roi " << roi_to_string(config) << "\n";
+
+        benchmark_results results;
+        try {
+            log.log(log_config, (double) (i + 1));
+            results = run_benchmark_config(config, &log);
+        }
+        catch (const rs2::error& e)
+        {
+            std::cerr << "Skipping config, RealSense error calling " << e.get_failed_function() << ": " << e.what() << "\n";
+            continue;
+        }
+
+        sweep_results << to_string(config.color) << "," << to_string(config.depth) << ","
+                      << (config.align_to_color ? "on" : "off") << "," << (config.save_to_disk ? "on" : "off") << ","
+                      << roi_to_string(config) << ","
+                      << results.frames_grabbed << "," << results.elapsed_s << "," << results.throughput_fps();
+        write_percentiles(sweep_results, results.time_taken_to_receive);
+        write_percentiles(sweep_results, results.time_between_frame_receipts);
+        write_percentiles(sweep_results, results.time_taken_to_extract);
+        write_percentiles(sweep_results, results.time_taken_to_save);
+        for(const std::string& stage : stages){
+            auto m = std::find_if(results.stage_metrics.begin(), results.stage_metrics.end(),
+                                  [&stage](const std::pair<std::string, std::vector<double>>& metric)
+            {
+                return metric.first == stage;
+            });
+            if(m != results.stage_metrics.end()){
+                write_percentiles(sweep_results, m->second);
+            } else {
+                sweep_results << ",,,,";
+            }
+        }
+        sweep_results << "\n";
+        sweep_results.flush();
+    }
+    std::cout << "Saved Sweep Results to " << results_path << "\n";
+}
@@ -0,0 +1,39 @@
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include <string>
+#include <vector>
+#include "benchmark_runner.hpp"
+
+// Matrix of settings to benchmark, every combination is run once.
+//
+// Sweep file, one setting per line followed by its values ('#' starts a comment):
+//     color    1920x1080:RGB8@30 1280x720:RGB8@30
+//     depth    1280x720:Z16@30 848x480:Z16@30
+//     align    off on
+//     save     off on
+//     roi      full 0.5 0.25 640x360+320+180
+//     frames   120
+//     duration 0
+// frames 0 with duration 0 plays a bag recording once to the end.
+struct sweep_matrix {
+    std::vector<stream_profile> color;
+    std::vector<stream_profile> depth;
+    std::vector<bool> align_to_color;
+    std::vector<bool> save_to_disk;
+    std::vector<std::string> roi;
+    uint32_t num_frames = 120;
+    double duration_s = 0;
+};
+
+bool read_sweep_file(const std::string& path, sweep_matrix& matrix);
+
+// Every setting not in the matrix (bag file, logging, processing stages) is taken from base
+std::vector<benchmark_config> expand_sweep(const sweep_matrix& matrix, const benchmark_config& base);
+
+// Runs every config and writes one row per config with per-column percentiles.
+// Configs the device or recording can't provide are reported and skipped.
+// Per-frame timings of all configs go to one logger made from the first config's log_options.
+void run_sweep(const std::vector<benchmark_config>& configs, const std::string& results_path);
+
+#endif //SWEEP_HPP
@@ -5,6 +5,10 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include "async_logger.hpp"
+#include "icp_odometry.hpp"
+#include "tsdf_volume.hpp"
 
 //TODO: command line arg for num frames and resolution, save benchmark results to file
 inline bool prompt_yes_no(const std::string& prompt_msg);
@@ -16,6 +20,8 @@ int main() {
 
     //bool save_img_to_disk = prompt_yes_no("Save Images to Disk? ");
     uint32_t n_buffer = get_user_selection("What Buffer Size? (Recommended: 10): ");
+    bool estimate_motion = prompt_yes_no("Estimate camera motion between frames? ");
+    bool fuse_frames = prompt_yes_no("Fuse frames into one surface? ");
     //bool save_benchmark_to_disk = prompt_yes_no("Save Benchmark to Disk?");
 
     long save_ms;
@@ -28,9 +34,23 @@ int main() {
     int fps_counter = 0; // for counting FPS
     int frame_counter = 0; // for counting how many frames until # of frames user has requested
 
+    // Per-frame timings go through the background logger so printing doesn't stall the capture loop
+    async_logger log;
+    const uint16_t log_receive = log.event("Time Taken to Receive:", "ms");
+    const uint16_t log_between = log.event("Time Between Two Frame Receipts: ", "ms");
+    const uint16_t log_extract = log.event("Time taken to extract:", "ms");
+    const uint16_t log_save = log.event("Time taken to save:", "ms");
+    const uint16_t log_fps = log.event("FPS: ", " -------------------------------------------------------");
+    const uint16_t log_icp = log.event("Time taken to register:", "ms");
+    const uint16_t log_icp_iterations = log.event("ICP iterations: ");
+    const uint16_t log_icp_lost = log.event("Tracking lost at frame ");
+    const uint16_t log_fuse = log.event("Time taken to fuse:", "ms");
+
     // initialize buffer
     std::vector<rs2::points> points_buffer(n_buffer);
     std::vector<rs2::frame> color_buffer(n_buffer);
+    std::vector<rs2::frame> depth_buffer(n_buffer);
+    std::vector<rs2::frameset> frameset_buffer(n_buffer); // unaligned, for registration and fusion
     //rs2::points points_buffer[10] = {};
     //rs2::frame color_buffer[10] = {};
 
@@ -61,8 +81,8 @@ int main() {
         frame_receipts_ms = std::chrono::duration_cast<std::chrono::milliseconds>(receive_time - prev_time).count();
         frameset_wait_for_receipts_ms = std::chrono::duration_cast<std::chrono::milliseconds>(receive_time - start_waiting_for_frames).count();
 
-        std::cout << "Time Taken to Receive:" << frameset_wait_for_receipts_ms << "ms \n";
-        std::cout << "Time Between Two Frame Receipts: " << frame_receipts_ms << "ms \n";
+        log.log(log_receive, frameset_wait_for_receipts_ms);
+        log.log(log_between, frame_receipts_ms);
 
         if(frame_counter != 0){
             time_between_frame_receipts[frame_counter-1] = frame_receipts_ms;
@@ -71,6 +91,12 @@ int main() {
 
         prev_time = receive_time;
 
+        // Registration and fusion use the native depth, kept out of the pipeline's frame pool
+        if(estimate_motion || fuse_frames){
+            frames.keep();
+            frameset_buffer[idx] = frames;
+        }
+
         // Align depth to color stream
         rs2_stream color_stream = RS2_STREAM_COLOR;
         rs2::align align(color_stream);
@@ -88,13 +114,14 @@ int main() {
         // keep filling buffer while it is not full
         points_buffer[idx] = points;
         color_buffer[idx] = color;
+        depth_buffer[idx] = depth;
 
         std::chrono::system_clock::time_point extracted_time = std::chrono::system_clock::now();
-        std::cout << "Time taken to extract:" << std::chrono::duration_cast<std::chrono::milliseconds>(extracted_time - receive_time).count() << "ms \n";
+        log.log(log_extract, std::chrono::duration_cast<std::chrono::milliseconds>(extracted_time - receive_time).count());
 
         // Print out FPS
         if(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - fps_time).count() == 1){
-            std::cout << "FPS: " << fps_counter << " -------------------------------------------------------\n";
+            log.log(log_fps, fps_counter);
             fps_counter = 0;
             fps_time = std::chrono::system_clock::now();
         }
@@ -107,6 +134,72 @@ int main() {
     // stop pipeline and free camera
     p.stop();
 
+    // Camera motion between consecutive frames, poses (TUM format) saved next to the clouds.
+    // Fusing needs the poses, so it implies estimating motion.
+    if((estimate_motion || fuse_frames) && n_buffer > 0){
+        icp_odometry odometry;
+        tsdf_volume volume;
+        rs2::align to_depth(RS2_STREAM_DEPTH);
+        std::ofstream poses("../results/poses.txt");
+        double total_ms = 0;
+        double fuse_ms = 0;
+        uint32_t fused = 0;
+        int total_iterations = 0;
+        for(uint32_t i=0; i<n_buffer; i++){
+            // Depth aligned to 1080p color would have 2.25x the pixels of the 1280x720 depth for no more
+            // measurements, and ICP and the TSDF cost grows with the pixel count
+            rs2::depth_frame depth = frameset_buffer[i].get_depth_frame();
+            pinhole camera(depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics());
+            organized_cloud cloud = organized_cloud::from_points(pc.calculate(depth), depth.get_width(), depth.get_height());
+
+            icp_odometry::result result = odometry.track(cloud, camera);
+            log.log(log_icp, result.ms);
+            log.log(log_icp_iterations, result.iterations);
+            // The first frame has nothing to register against but defines the coordinates
+            bool tracked = i == 0 || result.valid;
+            if(!tracked){
+                log.log(log_icp_lost, i);
+            }
+            total_ms += result.ms;
+            total_iterations += result.iterations;
+
+            // Poses of lost frames are only held over from the last tracked frame, they are kept as
+            // comments so trajectory tools skip them. Later frames register against that frame too.
+            if(!tracked){
+                poses << "# tracking lost: ";
+            }
+            write_tum_pose(poses, depth.get_timestamp() / 1000, odometry.pose());
+
+            // A lost frame would be fused at the wrong pose and smear the surface
+            if(fuse_frames && tracked){
+                std::chrono::steady_clock::time_point fuse_start = std::chrono::steady_clock::now();
+                // Color reprojected to the depth image, integrate wants it in the cloud's layout
+                rs2::frameset color_at_depth = to_depth.process(frameset_buffer[i]);
+                color_image color(color_at_depth.get_color_frame());
+                volume.integrate(cloud, camera, odometry.pose(), &color);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fuse_start).count();
+                log.log(log_fuse, ms);
+                fuse_ms += ms;
+                fused++;
+            }
+        }
+        std::cout << "Registered " << n_buffer << " frames, " << total_ms / n_buffer << " ms and "
+                  << (double) total_iterations / std::max(1u, n_buffer - 1) << " iterations per frame" << std::endl;
+
+        if(fuse_frames){
+            std::chrono::steady_clock::time_point extract_start = std::chrono::steady_clock::now();
+            point_cloud surface = volume.extract_surface();
+            write_ply("../results/pointcloud/fused.ply", surface);
+            double extract_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - extract_start).count();
+
+            // Compare against how long the sequence took to record
+            double sequence_ms = depth_buffer[n_buffer-1].get_timestamp() - depth_buffer[0].get_timestamp();
+            std::cout << "Fused " << fused << " of " << n_buffer << " frames (" << volume.block_count() << " blocks) in " << fuse_ms
+                      << " ms, surface of " << surface.size() << " points extracted in " << extract_ms
+                      << " ms; sequence length " << sequence_ms << " ms" << std::endl;
+        }
+    }
+
     // start saving
     for(int i=0; i<n_buffer; i++){
 
@@ -120,7 +213,7 @@ int main() {
 
         std::chrono::system_clock::time_point save_time = std::chrono::system_clock::now();
         save_ms = std::chrono::duration_cast<std::chrono::milliseconds>(save_time - start_time).count();
-        std::cout << "Time taken to save:" << save_ms << "ms \n";
+        log.log(log_save, save_ms);
 
         if(frame_counter != 0){
             time_taken_to_save[frame_counter-1] = save_ms;
@@ -0,0 +1,171 @@
+#include "async_logger.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+async_logger::async_logger() : async_logger(options())
+{
+}
+
+async_logger::async_logger(const options& opts) : opts(opts), out(&std::cout)
+{
+    size_t capacity = 2;
+    while(capacity < opts.capacity){
+        capacity <<= 1;
+    }
+    mask = capacity - 1;
+    cells.reset(new cell[capacity]);
+    for(size_t i = 0; i < capacity; i++){
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    if(!opts.path.empty()){
+        std::ios::openmode mode = opts.mode == output_mode::binary ? std::ios::out | std::ios::binary : std::ios::out;
+        file.open(opts.path, mode);
+        out = &file;
+    }
+
+    start_time = std::chrono::steady_clock::now();
+    worker = std::thread(&async_logger::run, this);
+}
+
+async_logger::~async_logger()
+{
+    running = false;
+    worker.join();
+
+    if(dropped() > 0 || suppressed_lines > 0){
+        std::cerr << "async_logger: " << dropped() << " records dropped, " << suppressed_lines << " lines rate limited\n";
+    }
+
+    // Binary logs only store event ids, keep their names next to the file
+    if(opts.mode == output_mode::binary && !opts.path.empty()){
+        std::ofstream names(opts.path + ".events");
+        names << "id,label,unit\n";
+        for(uint32_t i = 0; i < num_events.load(); i++){
+            names << i << "," << events[i].label << "," << events[i].unit << "\n";
+        }
+    }
+}
+
+uint16_t async_logger::event(const std::string& label, const std::string& unit)
+{
+    std::lock_guard<std::mutex> lock(register_mutex);
+    uint32_t id = num_events.load(std::memory_order_relaxed);
+    for(uint32_t i = 0; i < id; i++){
+        if(events[i].label == label){
+            return (uint16_t) i;
+        }
+    }
+    if(id >= max_events){
+        throw std::runtime_error("async_logger: too many events registered");
+    }
+    events[id].label = label;
+    events[id].unit = unit;
+    num_events.store(id + 1, std::memory_order_release);
+    return (uint16_t) id;
+}
+
+// Bounded MPMC queue (Vyukov): each cell's sequence says whose turn it is, so producers only contend on one CAS
+bool async_logger::log(uint16_t event, double value)
+{
+    uint64_t timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    cell* c;
+    while(true){
+        c = &cells[pos & mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if(diff == 0){
+            if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                break;
+            }
+        } else if(diff < 0){
+            dropped_records.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    c->data.timestamp_ns = timestamp_ns;
+    c->data.event = event;
+    c->data.value = value;
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool async_logger::try_pop(record& r)
+{
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    cell* c;
+    while(true){
+        c = &cells[pos & mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+        if(diff == 0){
+            if(dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                break;
+            }
+        } else if(diff < 0){
+            return false;
+        } else {
+            pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    r = c->data;
+    c->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+}
+
+void async_logger::write(const record& r)
+{
+    if(opts.mode == output_mode::binary){
+        out->write(reinterpret_cast<const char*>(&r.timestamp_ns), sizeof(r.timestamp_ns));
+        out->write(reinterpret_cast<const char*>(&r.event), sizeof(r.event));
+        out->write(reinterpret_cast<const char*>(&r.value), sizeof(r.value));
+        return;
+    }
+
+    // Fixed one second windows, anything over the limit is only counted
+    if(opts.max_lines_per_second > 0){
+        if(r.timestamp_ns - window_start_ns >= 1000000000ull){
+            if(window_lines > opts.max_lines_per_second){
+                *out << "(" << window_lines - opts.max_lines_per_second << " log lines suppressed)\n";
+            }
+            window_start_ns = r.timestamp_ns;
+            window_lines = 0;
+        }
+        if(++window_lines > opts.max_lines_per_second){
+            suppressed_lines++;
+            return;
+        }
+    }
+
+    const event_info& e = events[r.event];
+    *out << e.label << r.value << e.unit << " \n";
+}
+
+void async_logger::run()
+{
+    record r;
+    while(true){
+        // Read the flag before draining so nothing logged before shutdown is lost
+        bool stopping = !running.load();
+        bool wrote = false;
+        while(try_pop(r)){
+            write(r);
+            wrote = true;
+        }
+        if(wrote){
+            out->flush();
+        }
+        if(stopping){
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    out->flush();
+}
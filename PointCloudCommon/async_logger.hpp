@@ -0,0 +1,97 @@
+#ifndef ASYNC_LOGGER_HPP
+#define ASYNC_LOGGER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Logger for the capture loops. log() only copies a fixed-size record into a lock-free ring,
+// formatting and I/O happen on a background thread. When the ring is full the record is dropped
+// and counted instead of blocking the frame loop.
+//
+//     async_logger log;
+//     uint16_t receive = log.event("Time Taken to Receive:", "ms");
+//     log.log(receive, 12.5);    // prints "Time Taken to Receive:12.5ms"
+class async_logger {
+public:
+    enum class output_mode {
+        text,  // one formatted line per record
+        binary // raw records, for high-frequency timing events
+    };
+    // Binary records are 20 bytes, native endian: uint64 ns since logger start, uint32 event id,
+    // double value. Event names are written to <path>.events when the logger is destroyed.
+
+    struct options {
+        output_mode mode = output_mode::text;
+        std::string path;                  // empty writes text to stdout
+        size_t capacity = 4096;            // records in flight, rounded up to a power of two
+        uint32_t max_lines_per_second = 0; // text mode only, 0 is unlimited
+    };
+
+    async_logger();
+    explicit async_logger(const options& opts);
+    ~async_logger();
+
+    async_logger(const async_logger&) = delete;
+    async_logger& operator=(const async_logger&) = delete;
+
+    // Registers an event once, outside the hot loop. Labels are copied, registering the same label
+    // again returns its existing id.
+    uint16_t event(const std::string& label, const std::string& unit = "");
+
+    // Lock-free, safe from any thread. Returns false if the record was dropped.
+    bool log(uint16_t event, double value);
+
+    uint64_t dropped() const { return dropped_records.load(std::memory_order_relaxed); }
+
+    static const size_t max_events = 256;
+
+private:
+    struct record {
+        uint64_t timestamp_ns;
+        uint32_t event;
+        double value;
+    };
+
+    struct cell {
+        std::atomic<size_t> sequence;
+        record data;
+    };
+
+    struct event_info {
+        std::string label;
+        std::string unit;
+    };
+
+    bool try_pop(record& r);
+    void write(const record& r);
+    void run();
+
+    options opts;
+    std::unique_ptr<cell[]> cells;
+    size_t mask;
+    std::atomic<size_t> enqueue_pos{0};
+    std::atomic<size_t> dequeue_pos{0};
+
+    event_info events[max_events];
+    std::atomic<uint32_t> num_events{0};
+    std::mutex register_mutex;
+
+    std::atomic<uint64_t> dropped_records{0};
+    uint64_t suppressed_lines = 0;
+    uint64_t window_start_ns = 0;
+    uint32_t window_lines = 0;
+
+    std::chrono::steady_clock::time_point start_time;
+    std::ofstream file;
+    std::ostream* out;
+    std::atomic<bool> running{true};
+    std::thread worker;
+};
+
+#endif //ASYNC_LOGGER_HPP
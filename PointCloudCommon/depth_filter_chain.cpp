@@ -0,0 +1,73 @@
+#include "depth_filter_chain.hpp"
+
+#include <chrono>
+#include <sstream>
+
+void depth_filter_chain::add(const std::string& name, const rs2::filter& block)
+{
+    // A repeated step gets its occurrence number, so every step has its own timing column
+    int occurrence = 1;
+    for(const step& s : steps){
+        occurrence += s.name == name || !s.name.compare(0, name.size() + 1, name + " ");
+    }
+    std::string unique_name = occurrence > 1 ? name + " " + std::to_string(occurrence) : name;
+    steps.push_back({unique_name, "Time taken to " + unique_name + ":", block, 0});
+}
+
+bool depth_filter_chain::parse(const std::string& spec)
+{
+    steps.clear();
+    bool in_disparity = false;
+
+    std::stringstream entries(spec);
+    std::string entry;
+    while(std::getline(entries, entry, ',')){
+        std::string name = entry.substr(0, entry.find(':'));
+        bool has_value = entry.find(':') != std::string::npos;
+        float value = has_value ? std::stof(entry.substr(entry.find(':') + 1)) : 0;
+
+        bool needs_disparity = name == "spatial" || name == "temporal";
+        if(needs_disparity && !in_disparity){
+            add("to disparity", rs2::disparity_transform(true));
+            in_disparity = true;
+        } else if(!needs_disparity && in_disparity){
+            add("to depth", rs2::disparity_transform(false));
+            in_disparity = false;
+        }
+
+        if(name == "decimation"){
+            rs2::decimation_filter block;
+            block.set_option(RS2_OPTION_FILTER_MAGNITUDE, has_value ? value : 2);
+            add("decimation", block);
+        } else if(name == "spatial"){
+            rs2::spatial_filter block;
+            block.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, has_value ? value : 0.5f);
+            add("spatial", block);
+        } else if(name == "temporal"){
+            rs2::temporal_filter block;
+            block.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, has_value ? value : 0.4f);
+            add("temporal", block);
+        } else if(name == "holes"){
+            rs2::hole_filling_filter block;
+            block.set_option(RS2_OPTION_HOLES_FILL, has_value ? value : 1);
+            add("hole filling", block);
+        } else {
+            steps.clear();
+            return false;
+        }
+    }
+    if(in_disparity){
+        add("to depth", rs2::disparity_transform(false));
+    }
+    return true;
+}
+
+rs2::frame depth_filter_chain::process(rs2::frame depth)
+{
+    for(step& s : steps){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        depth = s.block.process(depth);
+        s.last_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return depth;
+}
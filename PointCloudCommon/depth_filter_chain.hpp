@@ -0,0 +1,45 @@
+#ifndef DEPTH_FILTER_CHAIN_HPP
+#define DEPTH_FILTER_CHAIN_HPP
+
+#include <string>
+#include <vector>
+#include <librealsense2/rs.hpp>
+
+// Ordered librealsense post-processing blocks applied to depth before extraction, timed per block.
+//
+// Spec is a comma separated list, each entry optionally followed by :<value>
+//     decimation[:magnitude]   2 by default
+//     spatial[:alpha]          edge-preserving smoothing, alpha 0.5 by default
+//     temporal[:alpha]         alpha 0.4 by default
+//     holes[:mode]             0 fill from left, 1 farthest around, 2 nearest around (default 1)
+// Spatial and temporal run in disparity space as librealsense recommends, the conversions are
+// inserted automatically and timed as their own steps. Step names are unique: a step that occurs
+// again, such as the second "to disparity" in spatial,holes,temporal, is named "to disparity 2".
+class depth_filter_chain {
+public:
+    // Returns false and leaves the chain empty on an unknown filter
+    bool parse(const std::string& spec);
+
+    bool empty() const { return steps.empty(); }
+
+    rs2::frame process(rs2::frame depth);
+
+    size_t size() const { return steps.size(); }
+    const std::string& name(size_t i) const { return steps[i].name; }
+    const std::string& label(size_t i) const { return steps[i].label; }
+    double last_ms(size_t i) const { return steps[i].last_ms; }
+
+private:
+    struct step {
+        std::string name;
+        std::string label; // "Time taken to <name>:", for the logger
+        rs2::filter block;
+        double last_ms;
+    };
+
+    void add(const std::string& name, const rs2::filter& block);
+
+    std::vector<step> steps;
+};
+
+#endif //DEPTH_FILTER_CHAIN_HPP
@@ -0,0 +1,294 @@
+#include "euclidean_clustering.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include "parallel.hpp"
+
+namespace {
+
+// Union-find with path halving. Roots are always the smallest index of their set, so a tile that
+// only unites its own nodes never writes outside them.
+struct disjoint_sets {
+    std::vector<uint32_t> parent;
+
+    explicit disjoint_sets(size_t n) : parent(n)
+    {
+        for(size_t i = 0; i < n; i++){
+            parent[i] = (uint32_t) i;
+        }
+    }
+
+    uint32_t find(uint32_t x)
+    {
+        while(parent[x] != x){
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+
+    void unite(uint32_t a, uint32_t b)
+    {
+        a = find(a);
+        b = find(b);
+        if(a == b){
+            return;
+        }
+        if(a < b){
+            std::swap(a, b);
+        }
+        parent[a] = b;
+    }
+};
+
+inline bool close_enough(const point_cloud& cloud, uint32_t a, uint32_t b, float tolerance2)
+{
+    float dx = cloud.x[a] - cloud.x[b], dy = cloud.y[a] - cloud.y[b], dz = cloud.z[a] - cloud.z[b];
+    return dx * dx + dy * dy + dz * dz <= tolerance2;
+}
+
+// Per point root, grid adjacency
+std::vector<uint32_t> grid_components(const point_cloud& cloud, const cluster_params& params, unsigned num_threads)
+{
+    const int width = params.image_width, height = params.image_height;
+    const float tolerance2 = params.tolerance * params.tolerance;
+    std::vector<int32_t> at((size_t) width * height, -1);
+    for(size_t i = 0; i < cloud.size(); i++){
+        if(cloud.pixel[i] < at.size()){
+            at[cloud.pixel[i]] = (int32_t) i;
+        }
+    }
+
+    // Forward half of the 8-neighborhood, so each edge is seen once
+    const int offsets[4][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+    disjoint_sets sets(cloud.size());
+    auto connect_row = [&](int v, int last_row) {
+        for(int u = 0; u < width; u++){
+            int32_t a = at[(size_t) v * width + u];
+            if(a < 0){
+                continue;
+            }
+            for(const int* o : offsets){
+                int nu = u + o[0], nv = v + o[1];
+                if(nu < 0 || nu >= width || nv > last_row){
+                    continue;
+                }
+                int32_t b = at[(size_t) nv * width + nu];
+                if(b >= 0 && close_enough(cloud, a, b, tolerance2)){
+                    sets.unite(a, b);
+                }
+            }
+        }
+    };
+
+    // Row bands: edges stay inside the band, the rows below each band are joined afterwards
+    std::vector<int> band_end(num_threads, 0);
+    parallel_for(height, num_threads, [&](size_t begin, size_t end, unsigned t)
+    {
+        band_end[t] = (int) end;
+        for(size_t v = begin; v < end; v++){
+            connect_row((int) v, (int) end - 1);
+        }
+    });
+    for(int end : band_end){
+        if(end > 0 && end < height){
+            // Only the downward edges of the band's last row were skipped
+            int v = end - 1;
+            for(int u = 0; u < width; u++){
+                int32_t a = at[(size_t) v * width + u];
+                if(a < 0){
+                    continue;
+                }
+                for(int du = -1; du <= 1; du++){
+                    int nu = u + du;
+                    int32_t b = nu >= 0 && nu < width ? at[(size_t) end * width + nu] : -1;
+                    if(b >= 0 && close_enough(cloud, a, b, tolerance2)){
+                        sets.unite(a, b);
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> roots(cloud.size());
+    for(size_t i = 0; i < cloud.size(); i++){
+        roots[i] = sets.find((uint32_t) i);
+    }
+    return roots;
+}
+
+const int64_t key_bias = 1 << 20;
+
+inline uint64_t cell_key(int64_t ix, int64_t iy, int64_t iz)
+{
+    return ((uint64_t) ((ix + key_bias) & 0x1FFFFF) << 42) | ((uint64_t) ((iy + key_bias) & 0x1FFFFF) << 21)
+           | (uint64_t) ((iz + key_bias) & 0x1FFFFF);
+}
+
+// Per point root, voxel adjacency
+std::vector<uint32_t> voxel_components(const point_cloud& cloud, const cluster_params& params, unsigned num_threads)
+{
+    const float inv_size = 1.0f / params.tolerance;
+    std::vector<std::pair<uint64_t, uint32_t>> entries(cloud.size());
+    parallel_for(cloud.size(), num_threads, [&](size_t begin, size_t end, unsigned)
+    {
+        for(size_t i = begin; i < end; i++){
+            entries[i] = std::make_pair(cell_key((int64_t) std::floor(cloud.x[i] * inv_size), (int64_t) std::floor(cloud.y[i] * inv_size),
+                                                 (int64_t) std::floor(cloud.z[i] * inv_size)), (uint32_t) i);
+        }
+    });
+    // x is in the top bits, so each x slab of cells is contiguous after sorting
+    std::sort(entries.begin(), entries.end());
+
+    std::vector<uint64_t> cells;
+    std::vector<uint32_t> point_cell(cloud.size());
+    for(const auto& entry : entries){
+        if(cells.empty() || cells.back() != entry.first){
+            cells.push_back(entry.first);
+        }
+        point_cell[entry.second] = (uint32_t) cells.size() - 1;
+    }
+
+    // Tiles are cell ranges cut at slab boundaries, so only the +x neighbors can cross them
+    std::vector<size_t> tile_begin;
+    for(unsigned t = 0; t < num_threads; t++){
+        size_t b = cells.size() * t / num_threads;
+        while(b > 0 && b < cells.size() && (cells[b] >> 42) == (cells[b - 1] >> 42)){
+            b++;
+        }
+        if(tile_begin.empty() || b > tile_begin.back()){
+            tile_begin.push_back(b);
+        }
+    }
+    tile_begin.push_back(cells.size());
+
+    disjoint_sets sets(cells.size());
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> crossing(tile_begin.size() - 1);
+    parallel_for(tile_begin.size() - 1, num_threads, [&](size_t first_tile, size_t last_tile, unsigned)
+    {
+        for(size_t tile = first_tile; tile < last_tile; tile++){
+            size_t begin = tile_begin[tile], end = tile_begin[tile + 1];
+            for(size_t c = begin; c < end; c++){
+                int64_t ix = (int64_t) (cells[c] >> 42) - key_bias;
+                int64_t iy = (int64_t) ((cells[c] >> 21) & 0x1FFFFF) - key_bias;
+                int64_t iz = (int64_t) (cells[c] & 0x1FFFFF) - key_bias;
+                // The 13 neighbors that sort after this cell
+                for(int dx = 0; dx <= 1; dx++){
+                    for(int dy = dx ? -1 : 0; dy <= 1; dy++){
+                        for(int dz = (dx || dy) ? -1 : 1; dz <= 1; dz++){
+                            uint64_t key = cell_key(ix + dx, iy + dy, iz + dz);
+                            auto found = std::lower_bound(cells.begin() + c, cells.end(), key);
+                            if(found == cells.end() || *found != key){
+                                continue;
+                            }
+                            size_t n = found - cells.begin();
+                            if(n < end){
+                                sets.unite((uint32_t) c, (uint32_t) n);
+                            } else {
+                                crossing[tile].push_back(std::make_pair((uint32_t) c, (uint32_t) n));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+    for(const auto& edges : crossing){
+        for(const auto& edge : edges){
+            sets.unite(edge.first, edge.second);
+        }
+    }
+
+    std::vector<uint32_t> roots(cloud.size());
+    for(size_t i = 0; i < cloud.size(); i++){
+        // Cell indices are below the point count, so they index the caller's per-point tables too
+        roots[i] = sets.find(point_cell[i]);
+    }
+    return roots;
+}
+
+}
+
+clustering cluster_points(const point_cloud& cloud, const cluster_params& params)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    clustering out;
+    out.labels.assign(cloud.size(), -1);
+    if(cloud.size() == 0){
+        return out;
+    }
+
+    const unsigned num_threads = resolve_num_threads(params.num_threads);
+    bool grid = cloud.has_pixel() && params.image_width > 0 && params.image_height > 0;
+    std::vector<uint32_t> roots = grid ? grid_components(cloud, params, num_threads) : voxel_components(cloud, params, num_threads);
+
+    // Component sizes, then the ones within limits numbered largest first
+    std::vector<uint32_t> size(cloud.size(), 0);
+    for(uint32_t r : roots){
+        size[r]++;
+    }
+    std::vector<uint32_t> kept;
+    for(size_t r = 0; r < size.size(); r++){
+        if(size[r] >= std::max<size_t>(params.min_points, 1) && (params.max_points == 0 || size[r] <= params.max_points)){
+            kept.push_back((uint32_t) r);
+        }
+    }
+    std::stable_sort(kept.begin(), kept.end(), [&](uint32_t a, uint32_t b) { return size[a] > size[b]; });
+
+    std::vector<int32_t> cluster_of(cloud.size(), -1);
+    out.clusters.resize(kept.size());
+    for(size_t c = 0; c < kept.size(); c++){
+        cluster_of[kept[c]] = (int32_t) c;
+        point_cluster& cluster = out.clusters[c];
+        cluster.indices.reserve(size[kept[c]]);
+        for(int k = 0; k < 3; k++){
+            cluster.min[k] = std::numeric_limits<float>::max();
+            cluster.max[k] = -std::numeric_limits<float>::max();
+        }
+    }
+    for(size_t i = 0; i < cloud.size(); i++){
+        int32_t c = cluster_of[roots[i]];
+        out.labels[i] = c;
+        if(c < 0){
+            continue;
+        }
+        point_cluster& cluster = out.clusters[c];
+        cluster.indices.push_back((uint32_t) i);
+        float p[3] = {cloud.x[i], cloud.y[i], cloud.z[i]};
+        for(int k = 0; k < 3; k++){
+            cluster.min[k] = std::min(cluster.min[k], p[k]);
+            cluster.max[k] = std::max(cluster.max[k], p[k]);
+        }
+    }
+
+    out.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return out;
+}
+
+bool write_clusters(const std::string& path, const clustering& result)
+{
+    std::ofstream out(path);
+    if(!out.is_open()){
+        return false;
+    }
+    out << "Cluster,Points,Min X,Min Y,Min Z,Max X,Max Y,Max Z,Indices\n";
+    for(size_t c = 0; c < result.clusters.size(); c++){
+        const point_cluster& cluster = result.clusters[c];
+        out << c << "," << cluster.indices.size();
+        for(float v : cluster.min){
+            out << "," << v;
+        }
+        for(float v : cluster.max){
+            out << "," << v;
+        }
+        out << ",";
+        for(size_t i = 0; i < cluster.indices.size(); i++){
+            out << (i ? " " : "") << cluster.indices[i];
+        }
+        out << "\n";
+    }
+    return out.good();
+}
@@ -0,0 +1,47 @@
+#ifndef EUCLIDEAN_CLUSTERING_HPP
+#define EUCLIDEAN_CLUSTERING_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "point_cloud.hpp"
+
+struct cluster_params {
+    float tolerance = 0.02f;  // meters, neighbors closer than this join the same cluster (see cluster_points)
+    size_t min_points = 50;   // smaller components are left unlabeled
+    size_t max_points = 0;    // 0 for no limit
+    int image_width = 0;      // depth image size for clouds with pixel indices, enables grid adjacency
+    int image_height = 0;
+    unsigned num_threads = 0; // 0 uses every core
+};
+
+struct point_cluster {
+    std::vector<uint32_t> indices; // into the input cloud
+    float min[3];                  // axis-aligned bounds, meters
+    float max[3];
+};
+
+struct clustering {
+    std::vector<point_cluster> clusters; // largest first
+    std::vector<int32_t> labels;         // per input point, index into clusters or -1
+    double ms = 0;
+};
+
+// Connected components of a neighbor graph, found with a union-find.
+//
+// Clouds with pixel indices (and image_width/height set) connect each point to those of its 8
+// pixel-grid neighbors closer than tolerance. Others are bucketed into tolerance-sized voxels and
+// every point is connected to all points in its own and the 26 touching voxels, without a distance
+// check. That joins every pair closer than tolerance, but also pairs up to 2*sqrt(3)*tolerance
+// apart (far corners of two diagonal voxels), so clusters separated by a gap shorter than that can
+// merge. Lower the tolerance where such gaps must stay apart.
+//
+// Either way the work is split into tiles (row bands of the image, x slabs of the voxel grid).
+// Each thread unions the edges inside its tile, touching only its own nodes, and the edges that
+// cross tile borders are merged afterwards in one serial pass.
+clustering cluster_points(const point_cloud& cloud, const cluster_params& params);
+
+// CSV, one cluster per line: index, point count, bounds, then the point indices space separated
+bool write_clusters(const std::string& path, const clustering& result);
+
+#endif //EUCLIDEAN_CLUSTERING_HPP
@@ -0,0 +1,429 @@
+#include "icp_odometry.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include "parallel.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+pinhole::pinhole(const rs2_intrinsics& intrinsics)
+{
+    width = intrinsics.width;
+    height = intrinsics.height;
+    fx = intrinsics.fx;
+    fy = intrinsics.fy;
+    cx = intrinsics.ppx;
+    cy = intrinsics.ppy;
+}
+
+pinhole pinhole::half() const
+{
+    // Pixel centers: the new pixel 0 covers old pixels 0 and 1
+    pinhole out;
+    out.width = width / 2;
+    out.height = height / 2;
+    out.fx = fx * 0.5f;
+    out.fy = fy * 0.5f;
+    out.cx = (cx + 0.5f) * 0.5f - 0.5f;
+    out.cy = (cy + 0.5f) * 0.5f - 0.5f;
+    return out;
+}
+
+rigid_transform rigid_transform::operator*(const rigid_transform& other) const
+{
+    rigid_transform out;
+    for(int r = 0; r < 3; r++){
+        for(int c = 0; c < 3; c++){
+            out.rotation[3*r + c] = rotation[3*r] * other.rotation[c] + rotation[3*r + 1] * other.rotation[3 + c]
+                                  + rotation[3*r + 2] * other.rotation[6 + c];
+        }
+        out.translation[r] = rotation[3*r] * other.translation[0] + rotation[3*r + 1] * other.translation[1]
+                           + rotation[3*r + 2] * other.translation[2] + translation[r];
+    }
+    return out;
+}
+
+rigid_transform rigid_transform::inverse() const
+{
+    rigid_transform out;
+    for(int r = 0; r < 3; r++){
+        for(int c = 0; c < 3; c++){
+            out.rotation[3*r + c] = rotation[3*c + r];
+        }
+    }
+    for(int r = 0; r < 3; r++){
+        out.translation[r] = -(out.rotation[3*r] * translation[0] + out.rotation[3*r + 1] * translation[1]
+                               + out.rotation[3*r + 2] * translation[2]);
+    }
+    return out;
+}
+
+rigid_transform rigid_transform::exp(const double twist[6])
+{
+    rigid_transform out;
+    double wx = twist[0], wy = twist[1], wz = twist[2];
+    double theta = std::sqrt(wx * wx + wy * wy + wz * wz);
+    if(theta > 1e-12){
+        // Rodrigues
+        double kx = wx / theta, ky = wy / theta, kz = wz / theta;
+        double s = std::sin(theta), c = 1 - std::cos(theta);
+        out.rotation[0] = 1 - c * (ky * ky + kz * kz);
+        out.rotation[1] = -s * kz + c * kx * ky;
+        out.rotation[2] = s * ky + c * kx * kz;
+        out.rotation[3] = s * kz + c * kx * ky;
+        out.rotation[4] = 1 - c * (kx * kx + kz * kz);
+        out.rotation[5] = -s * kx + c * ky * kz;
+        out.rotation[6] = -s * ky + c * kx * kz;
+        out.rotation[7] = s * kx + c * ky * kz;
+        out.rotation[8] = 1 - c * (kx * kx + ky * ky);
+    }
+    out.translation[0] = twist[3];
+    out.translation[1] = twist[4];
+    out.translation[2] = twist[5];
+    return out;
+}
+
+void rigid_transform::quaternion(double q[4]) const
+{
+    const double* m = rotation;
+    double trace = m[0] + m[4] + m[8];
+    if(trace > 0){
+        double s = 0.5 / std::sqrt(trace + 1);
+        q[3] = 0.25 / s;
+        q[0] = (m[7] - m[5]) * s;
+        q[1] = (m[2] - m[6]) * s;
+        q[2] = (m[3] - m[1]) * s;
+    } else if(m[0] > m[4] && m[0] > m[8]){
+        double s = 2 * std::sqrt(1 + m[0] - m[4] - m[8]);
+        q[3] = (m[7] - m[5]) / s;
+        q[0] = 0.25 * s;
+        q[1] = (m[1] + m[3]) / s;
+        q[2] = (m[2] + m[6]) / s;
+    } else if(m[4] > m[8]){
+        double s = 2 * std::sqrt(1 + m[4] - m[0] - m[8]);
+        q[3] = (m[2] - m[6]) / s;
+        q[0] = (m[1] + m[3]) / s;
+        q[1] = 0.25 * s;
+        q[2] = (m[5] + m[7]) / s;
+    } else {
+        double s = 2 * std::sqrt(1 + m[8] - m[0] - m[4]);
+        q[3] = (m[3] - m[1]) / s;
+        q[0] = (m[2] + m[6]) / s;
+        q[1] = (m[5] + m[7]) / s;
+        q[2] = 0.25 * s;
+    }
+}
+
+void write_tum_pose(std::ostream& out, double timestamp_s, const rigid_transform& pose)
+{
+    double q[4];
+    pose.quaternion(q);
+    out << std::fixed << std::setprecision(6) << timestamp_s << " "
+        << pose.translation[0] << " " << pose.translation[1] << " " << pose.translation[2] << " "
+        << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << "\n";
+}
+
+namespace {
+
+// 21 entries of the upper triangle of J^T J, 6 of J^T r, then r^2
+const int num_sums = 28;
+
+// Correspondences of one row, structure-of-arrays so they can be accumulated four at a time
+struct row_buffer {
+    std::vector<float> j[6];
+    std::vector<float> r;
+    size_t n = 0;
+
+    void reserve(size_t size)
+    {
+        for(std::vector<float>& column : j){
+            column.resize(size);
+        }
+        r.resize(size);
+    }
+
+    void push(const float jacobian[6], float residual)
+    {
+        for(int k = 0; k < 6; k++){
+            j[k][n] = jacobian[k];
+        }
+        r[n++] = residual;
+    }
+};
+
+// A row is at most a few thousand terms, so float partial sums are fine; rows add up in double
+void accumulate_row(const row_buffer& row, double sums[num_sums])
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128 acc[num_sums];
+    for(int k = 0; k < num_sums; k++){
+        acc[k] = _mm_setzero_ps();
+    }
+    for(; i + 4 <= row.n; i += 4){
+        __m128 j[7];
+        for(int k = 0; k < 6; k++){
+            j[k] = _mm_loadu_ps(&row.j[k][i]);
+        }
+        j[6] = _mm_loadu_ps(&row.r[i]);
+
+        int k = 0;
+        for(int a = 0; a < 6; a++){
+            for(int b = a; b < 6; b++){
+                acc[k] = _mm_add_ps(acc[k], _mm_mul_ps(j[a], j[b]));
+                k++;
+            }
+        }
+        for(int a = 0; a < 7; a++){
+            acc[k] = _mm_add_ps(acc[k], _mm_mul_ps(j[a], j[6]));
+            k++;
+        }
+    }
+    for(int k = 0; k < num_sums; k++){
+        float lanes[4];
+        _mm_storeu_ps(lanes, acc[k]);
+        sums[k] += (double) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+    for(; i < row.n; i++){
+        float j[7] = {row.j[0][i], row.j[1][i], row.j[2][i], row.j[3][i], row.j[4][i], row.j[5][i], row.r[i]};
+        int k = 0;
+        for(int a = 0; a < 6; a++){
+            for(int b = a; b < 6; b++){
+                sums[k++] += j[a] * j[b];
+            }
+        }
+        for(int a = 0; a < 7; a++){
+            sums[k++] += j[a] * j[6];
+        }
+    }
+}
+
+// Solves (J^T J) x = -J^T r by Cholesky, false if the system is degenerate
+bool solve_normal_equations(const double sums[num_sums], double x[6])
+{
+    double a[6][6];
+    int k = 0;
+    for(int i = 0; i < 6; i++){
+        for(int j = i; j < 6; j++){
+            a[i][j] = a[j][i] = sums[k++];
+        }
+    }
+    double b[6];
+    for(int i = 0; i < 6; i++){
+        b[i] = -sums[21 + i];
+    }
+
+    double l[6][6] = {};
+    for(int i = 0; i < 6; i++){
+        for(int j = 0; j <= i; j++){
+            double s = a[i][j];
+            for(int m = 0; m < j; m++){
+                s -= l[i][m] * l[j][m];
+            }
+            if(i == j){
+                if(s <= 1e-12){
+                    return false;
+                }
+                l[i][i] = std::sqrt(s);
+            } else {
+                l[i][j] = s / l[j][j];
+            }
+        }
+    }
+    double y[6];
+    for(int i = 0; i < 6; i++){
+        double s = b[i];
+        for(int m = 0; m < i; m++){
+            s -= l[i][m] * y[m];
+        }
+        y[i] = s / l[i][i];
+    }
+    for(int i = 5; i >= 0; i--){
+        double s = y[i];
+        for(int m = i + 1; m < 6; m++){
+            s -= l[m][i] * x[m];
+        }
+        x[i] = s / l[i][i];
+    }
+    return true;
+}
+
+// 2x2 block average. Only points within 5% of the block's nearest depth are averaged,
+// so blocks on a depth edge don't produce points floating between the two surfaces.
+organized_cloud half_resolution(const organized_cloud& in)
+{
+    organized_cloud out;
+    out.resize(in.width / 2, in.height / 2);
+    for(int v = 0; v < out.height; v++){
+        for(int u = 0; u < out.width; u++){
+            size_t block[4] = {in.index(2*u, 2*v), in.index(2*u + 1, 2*v), in.index(2*u, 2*v + 1), in.index(2*u + 1, 2*v + 1)};
+            float nearest = 0;
+            for(size_t i : block){
+                if(in.valid[i] && (nearest == 0 || in.z[i] < nearest)){
+                    nearest = in.z[i];
+                }
+            }
+            if(nearest == 0){
+                continue;
+            }
+            float sx = 0, sy = 0, sz = 0;
+            int count = 0;
+            for(size_t i : block){
+                if(in.valid[i] && in.z[i] - nearest <= 0.05f * nearest){
+                    sx += in.x[i];
+                    sy += in.y[i];
+                    sz += in.z[i];
+                    count++;
+                }
+            }
+            size_t o = out.index(u, v);
+            out.x[o] = sx / count;
+            out.y[o] = sy / count;
+            out.z[o] = sz / count;
+            out.valid[o] = 1;
+        }
+    }
+    return out;
+}
+
+}
+
+icp_odometry::result icp_odometry::track(const organized_cloud& cloud, const pinhole& camera)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    result out;
+
+    // Pyramid of the new frame, with normals so it can be the target next time
+    std::vector<level> current(std::max(settings.levels, 1));
+    current[0].cloud = cloud;
+    current[0].camera = camera;
+    for(size_t l = 1; l < current.size(); l++){
+        current[l].cloud = half_resolution(current[l - 1].cloud);
+        current[l].camera = current[l - 1].camera.half();
+    }
+    normal_params normal_settings;
+    normal_settings.radius = settings.normal_radius;
+    normal_settings.num_threads = settings.num_threads;
+    for(level& l : current){
+        l.normals = estimate_normals(l.cloud, normal_settings);
+    }
+
+    if(previous.size() == current.size()){
+        // Constant velocity guess, then coarse to fine
+        rigid_transform estimate = last_motion;
+        bool tracked = true;
+        unsigned num_threads = resolve_num_threads(settings.num_threads);
+
+        for(int l = (int) current.size() - 1; l >= 0 && tracked; l--){
+            const level& source = current[l];
+            const level& target = previous[l];
+            const float max_distance = settings.max_distance * (1 << l);
+            const float max_distance2 = max_distance * max_distance;
+            int max_iterations = settings.iterations[std::min(l, 3)];
+
+            for(int iteration = 0; iteration < max_iterations; iteration++){
+                float rotation[9], translation[3];
+                for(int k = 0; k < 9; k++){
+                    rotation[k] = (float) estimate.rotation[k];
+                }
+                for(int k = 0; k < 3; k++){
+                    translation[k] = (float) estimate.translation[k];
+                }
+
+                std::vector<std::vector<double>> thread_sums(num_threads, std::vector<double>(num_sums, 0));
+                std::vector<size_t> thread_inliers(num_threads, 0);
+                parallel_for(source.cloud.height, num_threads, [&](size_t begin, size_t end, unsigned t)
+                {
+                    row_buffer row;
+                    row.reserve(source.cloud.width);
+                    double* sums = thread_sums[t].data();
+                    const pinhole& cam = target.camera;
+
+                    for(size_t v = begin; v < end; v++){
+                        row.n = 0;
+                        for(int u = 0; u < source.cloud.width; u++){
+                            size_t i = source.cloud.index(u, (int) v);
+                            if(!source.cloud.valid[i]){
+                                continue;
+                            }
+                            float sx = source.cloud.x[i], sy = source.cloud.y[i], sz = source.cloud.z[i];
+                            float px = rotation[0] * sx + rotation[1] * sy + rotation[2] * sz + translation[0];
+                            float py = rotation[3] * sx + rotation[4] * sy + rotation[5] * sz + translation[1];
+                            float pz = rotation[6] * sx + rotation[7] * sy + rotation[8] * sz + translation[2];
+                            if(pz <= 0){
+                                continue;
+                            }
+
+                            // Projective association: the target point seen along the same ray
+                            int tu = (int) std::lround(cam.fx * px / pz + cam.cx);
+                            int tv = (int) std::lround(cam.fy * py / pz + cam.cy);
+                            if(tu < 0 || tv < 0 || tu >= target.cloud.width || tv >= target.cloud.height){
+                                continue;
+                            }
+                            size_t j = target.cloud.index(tu, tv);
+                            if(!target.normals.valid[j]){
+                                continue;
+                            }
+                            float dx = px - target.cloud.x[j], dy = py - target.cloud.y[j], dz = pz - target.cloud.z[j];
+                            if(dx * dx + dy * dy + dz * dz > max_distance2){
+                                continue;
+                            }
+
+                            float nx = target.normals.nx[j], ny = target.normals.ny[j], nz = target.normals.nz[j];
+                            float jacobian[6] = {py * nz - pz * ny, pz * nx - px * nz, px * ny - py * nx, nx, ny, nz};
+                            row.push(jacobian, nx * dx + ny * dy + nz * dz);
+                        }
+                        accumulate_row(row, sums);
+                        thread_inliers[t] += row.n;
+                    }
+                });
+
+                double sums[num_sums] = {};
+                size_t inliers = 0;
+                for(unsigned t = 0; t < num_threads; t++){
+                    for(int k = 0; k < num_sums; k++){
+                        sums[k] += thread_sums[t][k];
+                    }
+                    inliers += thread_inliers[t];
+                }
+
+                double twist[6];
+                if(inliers < (size_t) settings.min_inliers || !solve_normal_equations(sums, twist)){
+                    tracked = false;
+                    break;
+                }
+                estimate = rigid_transform::exp(twist) * estimate;
+                out.iterations++;
+                if(l == 0){
+                    out.inliers = inliers;
+                    out.rmse = std::sqrt(sums[num_sums - 1] / inliers);
+                }
+
+                double update = 0;
+                for(double x : twist){
+                    update += x * x;
+                }
+                if(std::sqrt(update) < settings.min_update){
+                    break;
+                }
+            }
+        }
+
+        out.valid = tracked;
+        out.motion = tracked ? estimate : rigid_transform();
+        last_motion = out.motion;
+        world_pose = world_pose * out.motion;
+    }
+
+    // A lost frame has no pose to register against, so the next frame goes against the last one that
+    // tracked, which pose() still belongs to
+    if(previous.size() != current.size() || out.valid){
+        previous.swap(current);
+    }
+    out.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return out;
+}
@@ -0,0 +1,93 @@
+#ifndef ICP_ODOMETRY_HPP
+#define ICP_ODOMETRY_HPP
+
+#include <ostream>
+#include <vector>
+#include <librealsense2/rs.hpp>
+#include "organized_cloud.hpp"
+
+// Pinhole model of the image an organized cloud came from. Distortion is ignored, which is fine
+// for association since depth aligned to color and D400 depth are (near) rectified.
+struct pinhole {
+    int width = 0;
+    int height = 0;
+    float fx = 0, fy = 0, cx = 0, cy = 0;
+
+    pinhole() {}
+    explicit pinhole(const rs2_intrinsics& intrinsics);
+
+    // Same camera at half the resolution
+    pinhole half() const;
+};
+
+// p' = rotation * p + translation, rotation row-major
+struct rigid_transform {
+    double rotation[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    double translation[3] = {0, 0, 0};
+
+    rigid_transform operator*(const rigid_transform& other) const;
+    rigid_transform inverse() const;
+
+    // Small motion: rotation vector (radians) followed by translation
+    static rigid_transform exp(const double twist[6]);
+
+    // x, y, z, w
+    void quaternion(double q[4]) const;
+};
+
+// Frame-to-frame point-to-plane ICP for organized clouds.
+//
+// Correspondences come from projecting each point of the new frame into the previous one
+// (projective data association), so there is no search structure. Each level of a 2x pyramid is
+// solved coarse to fine; per iteration the point-to-plane residuals and their Jacobians are packed
+// per row and the 6x6 normal equations accumulated four correspondences at a time with SSE2
+// where available, rows split over threads.
+class icp_odometry {
+public:
+    struct params {
+        int levels = 3;
+        int iterations[4] = {10, 5, 4, 4}; // per level, finest first
+        float max_distance = 0.10f;        // meters, correspondence rejection at the finest level
+        float min_update = 1e-6f;          // stop a level once the twist gets this small
+        int min_inliers = 100;
+        int normal_radius = 2;             // pixels, at every level
+        unsigned num_threads = 0;          // 0 uses every core
+    };
+
+    struct result {
+        rigid_transform motion; // new frame in the previous frame's coordinates
+        bool valid = false;     // false for the first frame, or when tracking failed (motion is then identity,
+                                // the pose holds still and the frame is dropped: the next one registers
+                                // against the last tracked frame, without a velocity guess)
+        int iterations = 0;     // summed over levels
+        size_t inliers = 0;     // at the finest level, last iteration
+        double rmse = 0;        // point-to-plane, meters
+        double ms = 0;
+    };
+
+    icp_odometry() {}
+    explicit icp_odometry(const params& p) : settings(p) {}
+
+    // Registers cloud against the last tracked cloud and advances pose()
+    result track(const organized_cloud& cloud, const pinhole& camera);
+
+    // Current camera in the first frame's coordinates
+    const rigid_transform& pose() const { return world_pose; }
+
+private:
+    struct level {
+        organized_cloud cloud;
+        organized_normals normals;
+        pinhole camera;
+    };
+
+    params settings;
+    std::vector<level> previous;
+    rigid_transform world_pose;
+    rigid_transform last_motion;
+};
+
+// One TUM RGB-D style line: "timestamp tx ty tz qx qy qz qw"
+void write_tum_pose(std::ostream& out, double timestamp_s, const rigid_transform& pose);
+
+#endif //ICP_ODOMETRY_HPP
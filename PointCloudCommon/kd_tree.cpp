@@ -0,0 +1,246 @@
+#include "kd_tree.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include "parallel.hpp"
+
+const uint32_t kd_tree::no_point;
+const uint32_t kd_tree::leaf_axis;
+
+uint32_t kd_tree::count_nodes(uint32_t n) const
+{
+    if(n <= leaf_size){
+        return 1;
+    }
+    return 1 + count_nodes(n / 2) + count_nodes(n - n / 2);
+}
+
+void kd_tree::build(const point_cloud& cloud, unsigned num_threads, uint32_t leaf)
+{
+    leaf_size = std::max(leaf, 1u);
+    uint32_t n = (uint32_t) cloud.size();
+    order.resize(n);
+    for(uint32_t i = 0; i < n; i++){
+        order[i] = i;
+    }
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    nodes.assign(n > 0 ? count_nodes(n) : 0, node());
+    if(n == 0){
+        return;
+    }
+
+    // Spawn a thread for the right half of every split until there is one subtree per thread
+    int spawn_depth = 0;
+    for(unsigned t = resolve_num_threads(num_threads); t > 1; t = (t + 1) / 2){
+        spawn_depth++;
+    }
+    build_node(0, 0, n, cloud, spawn_depth);
+}
+
+void kd_tree::build_node(uint32_t node_index, uint32_t begin, uint32_t end, const point_cloud& cloud, int spawn_depth)
+{
+    node& current = nodes[node_index];
+    current.begin = begin;
+    current.end = end;
+
+    if(end - begin <= leaf_size){
+        current.axis = leaf_axis;
+        current.split = 0;
+        current.right = 0;
+        for(uint32_t i = begin; i < end; i++){
+            x[i] = cloud.x[order[i]];
+            y[i] = cloud.y[order[i]];
+            z[i] = cloud.z[order[i]];
+        }
+        return;
+    }
+
+    // Widest axis of this node's points
+    float lo[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    float hi[3] = {-lo[0], -lo[1], -lo[2]};
+    for(uint32_t i = begin; i < end; i++){
+        uint32_t p = order[i];
+        lo[0] = std::min(lo[0], cloud.x[p]); hi[0] = std::max(hi[0], cloud.x[p]);
+        lo[1] = std::min(lo[1], cloud.y[p]); hi[1] = std::max(hi[1], cloud.y[p]);
+        lo[2] = std::min(lo[2], cloud.z[p]); hi[2] = std::max(hi[2], cloud.z[p]);
+    }
+    uint32_t axis = 0;
+    for(uint32_t a = 1; a < 3; a++){
+        if(hi[a] - lo[a] > hi[axis] - lo[axis]){
+            axis = a;
+        }
+    }
+    const std::vector<float>& coord = axis == 0 ? cloud.x : axis == 1 ? cloud.y : cloud.z;
+
+    uint32_t mid = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                     [&](uint32_t a, uint32_t b) { return coord[a] < coord[b]; });
+
+    current.axis = axis;
+    current.split = coord[order[mid]];
+    current.right = node_index + 1 + count_nodes(mid - begin);
+    uint32_t right_index = current.right;
+
+    if(spawn_depth > 0){
+        std::thread right(&kd_tree::build_node, this, right_index, mid, end, std::cref(cloud), spawn_depth - 1);
+        build_node(node_index + 1, begin, mid, cloud, spawn_depth - 1);
+        right.join();
+    } else {
+        build_node(node_index + 1, begin, mid, cloud, 0);
+        build_node(right_index, mid, end, cloud, 0);
+    }
+}
+
+size_t kd_tree::knn(const float query[3], uint32_t k, uint32_t* indices, float* dist2) const
+{
+    if(k == 0 || nodes.empty()){
+        return 0;
+    }
+
+    // indices / dist2 double as the result list, kept sorted by insertion
+    size_t found = 0;
+    float worst = std::numeric_limits<float>::infinity();
+
+    struct pending { uint32_t node; float plane_dist2; };
+    pending stack[64];
+    int top = 0;
+    stack[top++] = {0, 0};
+
+    while(top > 0){
+        pending item = stack[--top];
+        if(item.plane_dist2 > worst){
+            continue;
+        }
+        const node* current = &nodes[item.node];
+
+        // Walk down to a leaf, pushing the far side of each split
+        while(current->axis != leaf_axis){
+            float diff = query[current->axis] - current->split;
+            uint32_t near_child = (uint32_t) (current - nodes.data()) + 1;
+            uint32_t far_child = current->right;
+            if(diff >= 0){
+                std::swap(near_child, far_child);
+            }
+            if(diff * diff <= worst){
+                stack[top++] = {far_child, diff * diff};
+            }
+            current = &nodes[near_child];
+        }
+
+        for(uint32_t i = current->begin; i < current->end; i++){
+            float dx = x[i] - query[0], dy = y[i] - query[1], dz = z[i] - query[2];
+            float d = dx * dx + dy * dy + dz * dz;
+            if(d >= worst && found == k){
+                continue;
+            }
+            size_t slot = found < k ? found++ : k - 1;
+            while(slot > 0 && dist2[slot - 1] > d){
+                dist2[slot] = dist2[slot - 1];
+                indices[slot] = indices[slot - 1];
+                slot--;
+            }
+            dist2[slot] = d;
+            indices[slot] = order[i];
+            if(found == k){
+                worst = dist2[k - 1];
+            }
+        }
+    }
+    return found;
+}
+
+size_t kd_tree::radius(const float query[3], float r, std::vector<uint32_t>& indices, std::vector<float>* dist2) const
+{
+    indices.clear();
+    if(dist2){
+        dist2->clear();
+    }
+    if(nodes.empty()){
+        return 0;
+    }
+
+    float r2 = r * r;
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while(top > 0){
+        const node& current = nodes[stack[--top]];
+        if(current.axis == leaf_axis){
+            for(uint32_t i = current.begin; i < current.end; i++){
+                float dx = x[i] - query[0], dy = y[i] - query[1], dz = z[i] - query[2];
+                float d = dx * dx + dy * dy + dz * dz;
+                if(d <= r2){
+                    indices.push_back(order[i]);
+                    if(dist2){
+                        dist2->push_back(d);
+                    }
+                }
+            }
+            continue;
+        }
+        float diff = query[current.axis] - current.split;
+        uint32_t left = (uint32_t) (&current - nodes.data()) + 1;
+        if(diff <= r){
+            stack[top++] = left;
+        }
+        if(diff >= -r){
+            stack[top++] = current.right;
+        }
+    }
+    return indices.size();
+}
+
+void kd_tree::knn_batch(const point_cloud& queries, uint32_t k, std::vector<uint32_t>& indices, std::vector<float>& dist2,
+                        unsigned num_threads) const
+{
+    indices.assign(queries.size() * k, no_point);
+    dist2.assign(queries.size() * k, std::numeric_limits<float>::infinity());
+    parallel_for(queries.size(), num_threads, [&](size_t begin, size_t end, unsigned)
+    {
+        for(size_t q = begin; q < end; q++){
+            float query[3] = {queries.x[q], queries.y[q], queries.z[q]};
+            knn(query, k, &indices[q * k], &dist2[q * k]);
+        }
+    });
+}
+
+void kd_tree::radius_batch(const point_cloud& queries, float r, std::vector<uint32_t>& offsets, std::vector<uint32_t>& indices,
+                           unsigned num_threads) const
+{
+    // Each thread collects its contiguous query range, then the ranges are concatenated in order
+    unsigned threads = resolve_num_threads(num_threads);
+    std::vector<std::vector<uint32_t>> chunk_indices(threads);
+    std::vector<std::vector<uint32_t>> chunk_counts(threads);
+    std::vector<size_t> chunk_begin(threads, queries.size());
+
+    parallel_for(queries.size(), threads, [&](size_t begin, size_t end, unsigned t)
+    {
+        std::vector<uint32_t> found;
+        chunk_begin[t] = begin;
+        for(size_t q = begin; q < end; q++){
+            float query[3] = {queries.x[q], queries.y[q], queries.z[q]};
+            radius(query, r, found);
+            chunk_counts[t].push_back((uint32_t) found.size());
+            chunk_indices[t].insert(chunk_indices[t].end(), found.begin(), found.end());
+        }
+    });
+
+    std::vector<unsigned> chunks;
+    for(unsigned t = 0; t < threads; t++){
+        chunks.push_back(t);
+    }
+    std::sort(chunks.begin(), chunks.end(), [&](unsigned a, unsigned b) { return chunk_begin[a] < chunk_begin[b]; });
+
+    offsets.assign(1, 0);
+    offsets.reserve(queries.size() + 1);
+    indices.clear();
+    for(unsigned t : chunks){
+        for(uint32_t count : chunk_counts[t]){
+            offsets.push_back(offsets.back() + count);
+        }
+        indices.insert(indices.end(), chunk_indices[t].begin(), chunk_indices[t].end());
+    }
+}
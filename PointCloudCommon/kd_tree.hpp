@@ -0,0 +1,58 @@
+#ifndef KD_TREE_HPP
+#define KD_TREE_HPP
+
+#include <cstdint>
+#include <vector>
+#include "point_cloud.hpp"
+
+// Static KD-tree over a point_cloud's x/y/z for nearest-neighbor and radius queries.
+//
+// Nodes live in one array in depth-first order (left child directly follows its parent) and the
+// points are copied into tree order, so a leaf is a contiguous run of x/y/z. Splits are at the
+// median of the widest axis, which makes subtree sizes known up front: the top levels are built
+// on separate threads, each writing its own slice of the node and point arrays.
+//
+// Results always refer to indices in the cloud passed to build().
+class kd_tree {
+public:
+    static const uint32_t no_point = 0xffffffff;
+
+    void build(const point_cloud& cloud, unsigned num_threads = 0, uint32_t leaf_size = 16);
+
+    size_t size() const { return order.size(); }
+
+    // Up to k nearest points, closest first. Returns how many were found.
+    size_t knn(const float query[3], uint32_t k, uint32_t* indices, float* dist2) const;
+
+    // Every point within radius, in no particular order. dist2 may be null.
+    size_t radius(const float query[3], float radius, std::vector<uint32_t>& indices, std::vector<float>* dist2 = nullptr) const;
+
+    // One query per point of queries, split over threads. Results are k per query, padded with
+    // no_point / infinity where the tree has fewer than k points.
+    void knn_batch(const point_cloud& queries, uint32_t k, std::vector<uint32_t>& indices, std::vector<float>& dist2,
+                   unsigned num_threads = 0) const;
+
+    // Results for query i are indices[offsets[i] .. offsets[i + 1])
+    void radius_batch(const point_cloud& queries, float radius, std::vector<uint32_t>& offsets, std::vector<uint32_t>& indices,
+                      unsigned num_threads = 0) const;
+
+private:
+    struct node {
+        float split;
+        uint32_t axis;  // 0-2, or leaf_axis
+        uint32_t begin; // point range in tree order
+        uint32_t end;
+        uint32_t right; // index of the right child, the left one is this + 1
+    };
+    static const uint32_t leaf_axis = 3;
+
+    uint32_t count_nodes(uint32_t n) const;
+    void build_node(uint32_t node_index, uint32_t begin, uint32_t end, const point_cloud& cloud, int spawn_depth);
+
+    uint32_t leaf_size = 16;
+    std::vector<node> nodes;
+    std::vector<float> x, y, z;    // tree order
+    std::vector<uint32_t> order;   // tree order -> cloud index
+};
+
+#endif //KD_TREE_HPP
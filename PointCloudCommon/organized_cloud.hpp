@@ -0,0 +1,69 @@
+#ifndef ORGANIZED_CLOUD_HPP
+#define ORGANIZED_CLOUD_HPP
+
+#include <cstdint>
+#include <vector>
+#include <librealsense2/rs.hpp>
+#include "point_cloud.hpp"
+
+// Point cloud kept in depth image layout, one slot per pixel (index y * width + x).
+// Neighbors come straight from the pixel grid, so per-frame analytics don't need a search structure.
+// valid is the per-pixel mask: 0 for no depth or anything masked out later.
+struct organized_cloud {
+    int width = 0;
+    int height = 0;
+    std::vector<float> x, y, z;
+    std::vector<uint8_t> valid;
+
+    size_t size() const { return x.size(); }
+    size_t index(int u, int v) const { return (size_t) v * width + u; }
+    bool is_valid(int u, int v) const { return valid[index(u, v)] != 0; }
+
+    void resize(int w, int h);
+    size_t valid_count() const;
+
+    // ANDs another per-pixel mask (non-zero keeps the pixel) into valid
+    void apply_mask(const std::vector<uint8_t>& mask);
+
+    // Valid pixels in the (2 * radius + 1)^2 window around (u, v), clipped to the image.
+    // Cost only depends on the radius. Returns the number of indices written to out.
+    size_t neighbors(int u, int v, int radius, std::vector<uint32_t>& out) const;
+
+    // Valid points as a dense cloud, with pixel indices
+    point_cloud to_point_cloud() const;
+
+    // width and height are the depth frame's, rs2::points doesn't carry them
+    static organized_cloud from_points(const rs2::points& points, int width, int height);
+
+    // Scatters a cloud that has pixel indices (extractor or from_rs2_points output) back to the grid
+    static organized_cloud from_point_cloud(const point_cloud& cloud, int width, int height);
+};
+
+struct normal_params {
+    int radius = 4;                 // half window in pixels
+    float max_depth_change = 0.05f; // relative to the center depth, larger jumps count as an edge
+    unsigned num_threads = 0;       // 0 uses every core
+};
+
+// Per-pixel normals in the cloud's layout, oriented towards the camera. valid is 0 where no normal
+// could be estimated (invalid center, too few neighbors, or a depth edge inside the window).
+struct organized_normals {
+    int width = 0;
+    int height = 0;
+    std::vector<float> nx, ny, nz;
+    std::vector<uint8_t> valid;
+
+    size_t valid_count() const;
+};
+
+// Average 3D gradient normals: the horizontal and vertical tangents are differences between the
+// mean points of the window halves either side of the pixel, and the normal is their cross product.
+// The means come from integral images of x, y, z and the valid count, so every pixel costs the
+// same whatever the radius.
+organized_normals estimate_normals(const organized_cloud& cloud, const normal_params& params);
+
+// Copies each point's normal from its pixel into cloud.nx/ny/nz (zero where there is none).
+// cloud needs pixel indices in the normals' image layout.
+void attach_normals(point_cloud& cloud, const organized_normals& normals, unsigned num_threads = 0);
+
+#endif //ORGANIZED_CLOUD_HPP
@@ -0,0 +1,248 @@
+#include "outlier_removal.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "kd_tree.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+// Points per unit of work, and how far apart consecutive chunks are handed out
+const size_t chunk_points = 1024;
+const size_t chunk_stride = 16;
+
+const int max_k = 32;
+
+// Statistical score is the mean neighbor distance, radius score the neighbor count.
+// Untested points keep NAN, isolated ones (no neighbor at all) get infinity.
+class neighbor_scorer {
+public:
+    neighbor_scorer(const point_cloud& cloud, const outlier_params& params, unsigned num_threads)
+        : cloud(cloud), params(params)
+    {
+        grid = cloud.has_pixel() && params.image_width > 0 && params.image_height > 0;
+        if(grid){
+            at.assign((size_t) params.image_width * params.image_height, -1);
+            for(size_t i = 0; i < cloud.size(); i++){
+                if(cloud.pixel[i] < at.size()){
+                    at[cloud.pixel[i]] = (int32_t) i;
+                }
+            }
+        } else {
+            tree.build(cloud, num_threads);
+        }
+    }
+
+    float score(size_t i, std::vector<uint32_t>& scratch) const
+    {
+        if(params.mode == outlier_params::filter::statistical){
+            return grid ? grid_mean_distance(i) : tree_mean_distance(i);
+        }
+        return grid ? grid_count(i) : tree_count(i, scratch);
+    }
+
+private:
+    float grid_mean_distance(size_t i) const
+    {
+        const int k = std::min(std::max(params.k, 1), max_k);
+        float nearest[max_k];
+        int found = 0;
+        visit_window(i, [&](float d2)
+        {
+            // Insertion into the k smallest so far, ascending
+            if(found == k && d2 >= nearest[k - 1]){
+                return true;
+            }
+            int j = found < k ? found++ : k - 1;
+            while(j > 0 && nearest[j - 1] > d2){
+                nearest[j] = nearest[j - 1];
+                j--;
+            }
+            nearest[j] = d2;
+            return true;
+        });
+        if(found == 0){
+            return INFINITY;
+        }
+        float sum = 0;
+        for(int j = 0; j < found; j++){
+            sum += std::sqrt(nearest[j]);
+        }
+        return sum / found;
+    }
+
+    float grid_count(size_t i) const
+    {
+        const float radius2 = params.radius * params.radius;
+        int count = 0;
+        visit_window(i, [&](float d2)
+        {
+            count += d2 <= radius2;
+            return count < params.min_neighbors;
+        });
+        return (float) count;
+    }
+
+    float tree_mean_distance(size_t i) const
+    {
+        // The point finds itself first
+        const int k = std::min(std::max(params.k, 1), max_k) + 1;
+        uint32_t indices[max_k + 1];
+        float dist2[max_k + 1];
+        float query[3] = {cloud.x[i], cloud.y[i], cloud.z[i]};
+        size_t found = tree.knn(query, k, indices, dist2);
+        if(found < 2){
+            return INFINITY;
+        }
+        float sum = 0;
+        for(size_t j = 1; j < found; j++){
+            sum += std::sqrt(dist2[j]);
+        }
+        return sum / (found - 1);
+    }
+
+    float tree_count(size_t i, std::vector<uint32_t>& scratch) const
+    {
+        float query[3] = {cloud.x[i], cloud.y[i], cloud.z[i]};
+        size_t found = tree.radius(query, params.radius, scratch);
+        return (float) (found > 0 ? found - 1 : 0);
+    }
+
+    // Calls fn(squared distance) for every valid pixel in the window around point i until it returns false
+    template<typename Fn>
+    void visit_window(size_t i, Fn fn) const
+    {
+        const int width = params.image_width, height = params.image_height, w = std::max(params.window, 1);
+        const int u = (int) (cloud.pixel[i] % width), v = (int) (cloud.pixel[i] / width);
+        const float px = cloud.x[i], py = cloud.y[i], pz = cloud.z[i];
+        for(int nv = std::max(v - w, 0); nv <= std::min(v + w, height - 1); nv++){
+            const int32_t* row = &at[(size_t) nv * width];
+            for(int nu = std::max(u - w, 0); nu <= std::min(u + w, width - 1); nu++){
+                int32_t j = row[nu];
+                if(j < 0 || (size_t) j == i){
+                    continue;
+                }
+                float dx = cloud.x[j] - px, dy = cloud.y[j] - py, dz = cloud.z[j] - pz;
+                if(!fn(dx * dx + dy * dy + dz * dz)){
+                    return;
+                }
+            }
+        }
+    }
+
+    const point_cloud& cloud;
+    const outlier_params& params;
+    bool grid = false;
+    std::vector<int32_t> at; // pixel -> point, -1 where empty
+    kd_tree tree;
+};
+
+}
+
+bool parse_outlier_params(const std::string& spec, outlier_params& params)
+{
+    std::string name = spec.substr(0, spec.find(':'));
+    std::string args = name.size() < spec.size() ? spec.substr(name.size() + 1) : "";
+    if(name == "statistical" || name == "stat"){
+        params.mode = outlier_params::filter::statistical;
+        if(!args.empty() && sscanf(args.c_str(), "%d:%f", &params.k, &params.std_ratio) < 1){
+            return false;
+        }
+        return params.k > 0 && params.k <= max_k;
+    }
+    if(name == "radius"){
+        params.mode = outlier_params::filter::radius;
+        if(!args.empty() && sscanf(args.c_str(), "%f:%d", &params.radius, &params.min_neighbors) < 1){
+            return false;
+        }
+        return params.radius > 0 && params.min_neighbors > 0;
+    }
+    return false;
+}
+
+outlier_result remove_outliers(const point_cloud& cloud, const outlier_params& params)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double, std::milli>(params.budget_ms));
+    outlier_result out;
+    if(cloud.size() == 0){
+        return out;
+    }
+
+    const unsigned num_threads = resolve_num_threads(params.num_threads);
+    neighbor_scorer scorer(cloud, params, num_threads);
+
+    // Chunk 0, 16, 32, ..., then 1, 17, ...: whatever prefix gets done is spread over the whole frame
+    const size_t chunks = (cloud.size() + chunk_points - 1) / chunk_points;
+    std::vector<uint32_t> chunk_order;
+    chunk_order.reserve(chunks);
+    for(size_t phase = 0; phase < std::min(chunk_stride, chunks); phase++){
+        for(size_t c = phase; c < chunks; c += chunk_stride){
+            chunk_order.push_back((uint32_t) c);
+        }
+    }
+
+    std::vector<float> scores(cloud.size(), NAN);
+    std::atomic<size_t> next_chunk(0);
+    std::vector<size_t> evaluated(num_threads, 0);
+    parallel_for(num_threads, num_threads, [&](size_t, size_t, unsigned t)
+    {
+        std::vector<uint32_t> scratch;
+        while(params.budget_ms <= 0 || std::chrono::steady_clock::now() < deadline){
+            size_t c = next_chunk++;
+            if(c >= chunks){
+                break;
+            }
+            size_t begin = chunk_order[c] * chunk_points, end = std::min(cloud.size(), begin + chunk_points);
+            for(size_t i = begin; i < end; i++){
+                scores[i] = scorer.score(i, scratch);
+            }
+            evaluated[t] += end - begin;
+        }
+    });
+    for(size_t n : evaluated){
+        out.evaluated += n;
+    }
+
+    std::vector<uint8_t> remove(cloud.size(), 0);
+    if(params.mode == outlier_params::filter::statistical){
+        // Threshold from the tested, non-isolated points
+        double sum = 0, sum2 = 0;
+        size_t n = 0;
+        for(float s : scores){
+            if(std::isfinite(s)){
+                sum += s;
+                sum2 += (double) s * s;
+                n++;
+            }
+        }
+        double mean = n ? sum / n : 0;
+        double stddev = n ? std::sqrt(std::max(0.0, sum2 / n - mean * mean)) : 0;
+        float threshold = (float) (mean + params.std_ratio * stddev);
+        for(size_t i = 0; i < cloud.size(); i++){
+            remove[i] = !std::isnan(scores[i]) && (std::isinf(scores[i]) || scores[i] > threshold);
+        }
+    } else {
+        for(size_t i = 0; i < cloud.size(); i++){
+            remove[i] = !std::isnan(scores[i]) && scores[i] < params.min_neighbors;
+        }
+    }
+
+    std::vector<uint32_t> keep;
+    keep.reserve(cloud.size());
+    for(size_t i = 0; i < cloud.size(); i++){
+        if(!remove[i]){
+            keep.push_back((uint32_t) i);
+        }
+    }
+    out.removed = cloud.size() - keep.size();
+    out.cloud = select_points(cloud, keep);
+
+    out.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return out;
+}
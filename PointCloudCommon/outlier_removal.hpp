@@ -0,0 +1,48 @@
+#ifndef OUTLIER_REMOVAL_HPP
+#define OUTLIER_REMOVAL_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "point_cloud.hpp"
+
+struct outlier_params {
+    enum class filter { statistical, radius };
+    filter mode = filter::statistical;
+
+    // statistical: points whose mean distance to their k nearest neighbors is more than
+    // std_ratio standard deviations above the frame's mean are removed
+    int k = 8;
+    float std_ratio = 1.0f;
+
+    // radius: points with fewer than min_neighbors others within radius are removed
+    float radius = 0.02f;
+    int min_neighbors = 4;
+
+    int window = 2;           // pixel-grid search half width, for clouds with pixel indices
+    int image_width = 0;      // depth image size, enables the grid search
+    int image_height = 0;
+
+    double budget_ms = 0;     // counted from the call, covers setup and testing but not copying out the kept points; 0 for no limit
+    unsigned num_threads = 0; // 0 uses every core
+};
+
+// "statistical[:k[:std_ratio]]" or "radius[:radius_m[:min_neighbors]]"
+bool parse_outlier_params(const std::string& spec, outlier_params& params);
+
+struct outlier_result {
+    point_cloud cloud;    // the points kept, all channels
+    size_t removed = 0;
+    size_t evaluated = 0; // points tested; the rest were kept untested because the budget ran out
+    double ms = 0;
+};
+
+// Neighbors come from the pixel grid when the cloud has pixel indices and the image size is set,
+// otherwise from a kd_tree built for the call.
+//
+// Points are tested in parallel, in chunks handed out in an interleaved order across the frame.
+// With a budget, threads stop taking chunks once it is spent and the untested points are kept,
+// so an overloaded frame is filtered evenly but more sparsely instead of running long.
+outlier_result remove_outliers(const point_cloud& cloud, const outlier_params& params);
+
+#endif //OUTLIER_REMOVAL_HPP
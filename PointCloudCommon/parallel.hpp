@@ -0,0 +1,39 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// 0 means one thread per hardware core
+inline unsigned resolve_num_threads(unsigned num_threads)
+{
+    if(num_threads == 0){
+        num_threads = std::thread::hardware_concurrency();
+    }
+    return std::max(1u, num_threads);
+}
+
+// Splits [0, n) into one contiguous chunk per thread and calls fn(begin, end, thread_index).
+// The calling thread runs the last chunk.
+template<typename Fn>
+void parallel_for(size_t n, unsigned num_threads, Fn fn)
+{
+    num_threads = (unsigned) std::min<size_t>(resolve_num_threads(num_threads), std::max<size_t>(n, 1));
+    size_t chunk = (n + num_threads - 1) / num_threads;
+
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t + 1 < num_threads; t++){
+        size_t begin = std::min(n, t * chunk);
+        size_t end = std::min(n, begin + chunk);
+        workers.push_back(std::thread(fn, begin, end, t));
+    }
+    size_t last_begin = std::min(n, (num_threads - 1) * chunk);
+    fn(last_begin, n, num_threads - 1);
+
+    for(std::thread& worker : workers){
+        worker.join();
+    }
+}
+
+#endif //PARALLEL_HPP
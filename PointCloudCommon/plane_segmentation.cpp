@@ -0,0 +1,289 @@
+#include "plane_segmentation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include "parallel.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+struct hypothesis {
+    float a, b, c, d;
+};
+
+// Points per chunk scored against a whole batch, small enough to stay in L1
+const size_t chunk_points = 2048;
+
+uint32_t count_inliers(const float* x, const float* y, const float* z, size_t n, const hypothesis& h, float threshold)
+{
+    size_t i = 0;
+    uint32_t count = 0;
+#ifdef __SSE2__
+    const __m128 a = _mm_set1_ps(h.a), b = _mm_set1_ps(h.b), c = _mm_set1_ps(h.c), d = _mm_set1_ps(h.d);
+    const __m128 t = _mm_set1_ps(threshold);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128i acc = _mm_setzero_si128();
+    for(; i + 4 <= n; i += 4){
+        __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(x + i)), _mm_mul_ps(b, _mm_loadu_ps(y + i))),
+                                 _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(z + i)), d));
+        // Inlier lanes are all ones, i.e. -1, so subtracting counts them
+        acc = _mm_sub_epi32(acc, _mm_castps_si128(_mm_cmple_ps(_mm_andnot_ps(sign, dist), t)));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for(; i < n; i++){
+        count += std::fabs(h.a * x[i] + h.b * y[i] + h.c * z[i] + h.d) <= threshold;
+    }
+    return count;
+}
+
+bool plane_through(const float p0[3], const float p1[3], const float p2[3], hypothesis& h)
+{
+    float u[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    float v[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    float n[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+    float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if(length < 1e-9f){
+        return false;
+    }
+    h.a = n[0] / length;
+    h.b = n[1] / length;
+    h.c = n[2] / length;
+    h.d = -(h.a * p0[0] + h.b * p0[1] + h.c * p0[2]);
+    return true;
+}
+
+// Least-squares plane: through the centroid, normal along the covariance's smallest eigenvector
+// (cyclic Jacobi, converges in a handful of sweeps for 3x3)
+bool fit_plane(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z,
+               const std::vector<uint32_t>& indices, hypothesis& h)
+{
+    if(indices.size() < 3){
+        return false;
+    }
+    double mean[3] = {0, 0, 0};
+    for(uint32_t i : indices){
+        mean[0] += x[i];
+        mean[1] += y[i];
+        mean[2] += z[i];
+    }
+    for(double& m : mean){
+        m /= indices.size();
+    }
+    double a[3][3] = {};
+    for(uint32_t i : indices){
+        double d[3] = {x[i] - mean[0], y[i] - mean[1], z[i] - mean[2]};
+        for(int r = 0; r < 3; r++){
+            for(int c = r; c < 3; c++){
+                a[r][c] += d[r] * d[c];
+            }
+        }
+    }
+    a[1][0] = a[0][1];
+    a[2][0] = a[0][2];
+    a[2][1] = a[1][2];
+
+    double v[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    for(int sweep = 0; sweep < 16; sweep++){
+        double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        if(off < 1e-20){
+            break;
+        }
+        for(int p = 0; p < 2; p++){
+            for(int q = p + 1; q < 3; q++){
+                if(std::fabs(a[p][q]) < 1e-30){
+                    continue;
+                }
+                double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                double t = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                double c = 1 / std::sqrt(t * t + 1), s = t * c;
+                for(int k = 0; k < 3; k++){
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for(int k = 0; k < 3; k++){
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for(int k = 0; k < 3; k++){
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    int smallest = 0;
+    for(int k = 1; k < 3; k++){
+        if(a[k][k] < a[smallest][smallest]){
+            smallest = k;
+        }
+    }
+    double n[3] = {v[0][smallest], v[1][smallest], v[2][smallest]};
+    double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if(length < 1e-12){
+        return false;
+    }
+    h.a = (float) (n[0] / length);
+    h.b = (float) (n[1] / length);
+    h.c = (float) (n[2] / length);
+    h.d = (float) -(h.a * mean[0] + h.b * mean[1] + h.c * mean[2]);
+    return true;
+}
+
+}
+
+plane_segmentation segment_planes(const point_cloud& cloud, const plane_params& params)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    plane_segmentation out;
+    out.labels.assign(cloud.size(), -1);
+
+    // Points not yet on a plane, compacted after every plane
+    std::vector<float> x(cloud.x), y(cloud.y), z(cloud.z);
+    std::vector<uint32_t> ids(cloud.size());
+    for(uint32_t i = 0; i < ids.size(); i++){
+        ids[i] = i;
+    }
+
+    const unsigned num_threads = resolve_num_threads(params.num_threads);
+    const int batch_size = std::max(params.batch_size, 1);
+    std::mt19937 rng(params.seed);
+
+    for(int p = 0; p < params.max_planes; p++){
+        size_t m = ids.size();
+        if(m < std::max<size_t>(params.min_inliers, 3)){
+            break;
+        }
+        std::uniform_int_distribution<size_t> pick(0, m - 1);
+
+        hypothesis best = {0, 0, 0, 0};
+        uint32_t best_count = 0;
+        double needed = params.max_hypotheses;
+        int evaluated = 0;
+        std::vector<hypothesis> batch;
+        std::vector<std::vector<uint32_t>> thread_counts(num_threads);
+
+        while(evaluated < needed && evaluated < params.max_hypotheses){
+            int n = std::min(batch_size, params.max_hypotheses - evaluated);
+            batch.clear();
+            for(int attempt = 0; (int) batch.size() < n && attempt < 10 * n; attempt++){
+                size_t i0 = pick(rng), i1 = pick(rng), i2 = pick(rng);
+                float p0[3] = {x[i0], y[i0], z[i0]}, p1[3] = {x[i1], y[i1], z[i1]}, p2[3] = {x[i2], y[i2], z[i2]};
+                hypothesis h;
+                if(plane_through(p0, p1, p2, h)){
+                    batch.push_back(h);
+                }
+            }
+            if(batch.empty()){
+                break;
+            }
+
+            parallel_for(m, num_threads, [&](size_t begin, size_t end, unsigned t)
+            {
+                std::vector<uint32_t>& counts = thread_counts[t];
+                counts.assign(batch.size(), 0);
+                for(size_t chunk = begin; chunk < end; chunk += chunk_points){
+                    size_t size = std::min(chunk_points, end - chunk);
+                    for(size_t h = 0; h < batch.size(); h++){
+                        counts[h] += count_inliers(&x[chunk], &y[chunk], &z[chunk], size, batch[h], params.distance);
+                    }
+                }
+            });
+            for(size_t h = 0; h < batch.size(); h++){
+                uint32_t count = 0;
+                for(const std::vector<uint32_t>& counts : thread_counts){
+                    count += counts.empty() ? 0 : counts[h];
+                }
+                if(count > best_count){
+                    best_count = count;
+                    best = batch[h];
+                }
+            }
+            evaluated += (int) batch.size();
+
+            // Hypotheses needed to draw one all-inlier sample with the requested confidence
+            double w = (double) best_count / m;
+            double all_inliers = w * w * w;
+            if(all_inliers >= 1){
+                needed = 0;
+            } else if(all_inliers > 0){
+                needed = std::log(1 - params.confidence) / std::log(1 - all_inliers);
+            }
+        }
+        out.hypotheses += evaluated;
+        if(best_count < params.min_inliers){
+            break;
+        }
+
+        // Refit on the inliers, keep whichever plane explains more points
+        std::vector<uint32_t> inliers;
+        for(size_t i = 0; i < m; i++){
+            if(std::fabs(best.a * x[i] + best.b * y[i] + best.c * z[i] + best.d) <= params.distance){
+                inliers.push_back((uint32_t) i);
+            }
+        }
+        hypothesis refined;
+        if(fit_plane(x, y, z, inliers, refined)
+           && count_inliers(x.data(), y.data(), z.data(), m, refined, params.distance) >= inliers.size()){
+            best = refined;
+            inliers.clear();
+            for(size_t i = 0; i < m; i++){
+                if(std::fabs(best.a * x[i] + best.b * y[i] + best.c * z[i] + best.d) <= params.distance){
+                    inliers.push_back((uint32_t) i);
+                }
+            }
+        }
+
+        plane_model model;
+        model.a = best.a;
+        model.b = best.b;
+        model.c = best.c;
+        model.d = best.d;
+        model.inliers = inliers.size();
+        out.planes.push_back(model);
+
+        // Label and drop the inliers (inliers is sorted, so compaction is one pass)
+        size_t kept = 0, next = 0;
+        for(size_t i = 0; i < m; i++){
+            if(next < inliers.size() && inliers[next] == i){
+                out.labels[ids[i]] = p;
+                next++;
+                continue;
+            }
+            x[kept] = x[i];
+            y[kept] = y[i];
+            z[kept] = z[i];
+            ids[kept] = ids[i];
+            kept++;
+        }
+        x.resize(kept);
+        y.resize(kept);
+        z.resize(kept);
+        ids.resize(kept);
+    }
+
+    out.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return out;
+}
+
+point_cloud remove_planes(const point_cloud& cloud, const plane_segmentation& segmentation)
+{
+    std::vector<uint32_t> keep;
+    keep.reserve(cloud.size());
+    for(size_t i = 0; i < segmentation.labels.size(); i++){
+        if(segmentation.labels[i] < 0){
+            keep.push_back((uint32_t) i);
+        }
+    }
+    return select_points(cloud, keep);
+}
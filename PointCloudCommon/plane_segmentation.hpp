@@ -0,0 +1,44 @@
+#ifndef PLANE_SEGMENTATION_HPP
+#define PLANE_SEGMENTATION_HPP
+
+#include <cstdint>
+#include <vector>
+#include "point_cloud.hpp"
+
+// a * x + b * y + c * z + d = 0 with (a, b, c) unit length
+struct plane_model {
+    float a = 0, b = 0, c = 0, d = 0;
+    size_t inliers = 0;
+};
+
+struct plane_params {
+    int max_planes = 3;
+    float distance = 0.02f;       // meters, inlier threshold
+    size_t min_inliers = 1000;    // smaller planes end the search
+    int max_hypotheses = 1000;    // per plane
+    int batch_size = 64;          // hypotheses scored together in one pass over the points
+    float confidence = 0.99f;     // stop once a better plane is this unlikely to be missed
+    uint32_t seed = 42;
+    unsigned num_threads = 0;     // 0 uses every core
+};
+
+struct plane_segmentation {
+    std::vector<plane_model> planes; // largest first
+    std::vector<int32_t> labels;     // per input point, index into planes or -1
+    int hypotheses = 0;              // scored over all planes
+    double ms = 0;
+};
+
+// Sequential multi-plane RANSAC: find the dominant plane, refine it by least squares over its
+// inliers, label and remove them, repeat on what's left.
+//
+// Hypotheses are scored a batch at a time. Threads split the points; each scores every hypothesis
+// of the batch on a cache-sized chunk before moving on, counting inliers four points at a time
+// with SSE2 where available. After each batch the adaptive RANSAC bound is recomputed from the
+// best inlier ratio so far, which usually ends the search after one or two batches on a large plane.
+plane_segmentation segment_planes(const point_cloud& cloud, const plane_params& params);
+
+// Points whose label is -1
+point_cloud remove_planes(const point_cloud& cloud, const plane_segmentation& segmentation);
+
+#endif //PLANE_SEGMENTATION_HPP
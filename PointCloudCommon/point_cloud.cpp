@@ -0,0 +1,317 @@
+#include "point_cloud.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+void point_cloud::clear()
+{
+    resize(0, false);
+    pixel.clear();
+}
+
+void point_cloud::reserve(size_t n, bool color, bool normals)
+{
+    x.reserve(n);
+    y.reserve(n);
+    z.reserve(n);
+    if(color){
+        r.reserve(n);
+        g.reserve(n);
+        b.reserve(n);
+    }
+    if(normals){
+        nx.reserve(n);
+        ny.reserve(n);
+        nz.reserve(n);
+    }
+}
+
+void point_cloud::resize(size_t n, bool color, bool normals)
+{
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    size_t color_n = color ? n : 0;
+    r.resize(color_n);
+    g.resize(color_n);
+    b.resize(color_n);
+    size_t normals_n = normals ? n : 0;
+    nx.resize(normals_n);
+    ny.resize(normals_n);
+    nz.resize(normals_n);
+}
+
+color_image::color_image(const rs2::video_frame& frame)
+{
+    if(!frame){
+        return;
+    }
+    rs2_format format = frame.get_profile().format();
+    data = static_cast<const uint8_t*>(frame.get_data());
+    width = frame.get_width();
+    height = frame.get_height();
+    stride = frame.get_stride_in_bytes();
+    bytes_per_pixel = frame.get_bytes_per_pixel();
+    bgr = format == RS2_FORMAT_BGR8 || format == RS2_FORMAT_BGRA8;
+}
+
+point_cloud from_rs2_points(const rs2::points& points, const rs2::video_frame& color, bool keep_invalid)
+{
+    point_cloud cloud;
+    color_image image(color);
+    bool has_color = image.data != nullptr;
+
+    const rs2::vertex* vertices = points.get_vertices();
+    const rs2::texture_coordinate* tex = points.get_texture_coordinates();
+    size_t n = points.size();
+    cloud.reserve(n, has_color);
+    cloud.pixel.reserve(n);
+
+    for(size_t i = 0; i < n; i++){
+        if(!keep_invalid && vertices[i].z <= 0){
+            continue;
+        }
+        cloud.pixel.push_back((uint32_t) i);
+        cloud.x.push_back(vertices[i].x);
+        cloud.y.push_back(vertices[i].y);
+        cloud.z.push_back(vertices[i].z);
+        if(has_color){
+            uint8_t r, g, b;
+            image.sample(tex[i].u, tex[i].v, r, g, b);
+            cloud.r.push_back(r);
+            cloud.g.push_back(g);
+            cloud.b.push_back(b);
+        }
+    }
+    return cloud;
+}
+
+point_cloud select_points(const point_cloud& cloud, const std::vector<uint32_t>& indices)
+{
+    point_cloud out;
+    out.resize(indices.size(), cloud.has_color(), cloud.has_normals());
+    if(cloud.has_pixel()){
+        out.pixel.resize(indices.size());
+    }
+    for(size_t i = 0; i < indices.size(); i++){
+        uint32_t p = indices[i];
+        out.x[i] = cloud.x[p];
+        out.y[i] = cloud.y[p];
+        out.z[i] = cloud.z[p];
+        if(cloud.has_color()){
+            out.r[i] = cloud.r[p];
+            out.g[i] = cloud.g[p];
+            out.b[i] = cloud.b[p];
+        }
+        if(cloud.has_normals()){
+            out.nx[i] = cloud.nx[p];
+            out.ny[i] = cloud.ny[p];
+            out.nz[i] = cloud.nz[p];
+        }
+        if(cloud.has_pixel()){
+            out.pixel[i] = cloud.pixel[p];
+        }
+    }
+    return out;
+}
+
+bool write_ply(const std::string& path, const point_cloud& cloud)
+{
+    std::ofstream out(path, std::ios::binary);
+    if(!out.is_open()){
+        return false;
+    }
+
+    bool color = cloud.has_color();
+    bool normals = cloud.has_normals();
+    out << "ply\nformat binary_little_endian 1.0\n"
+        << "element vertex " << cloud.size() << "\n"
+        << "property float x\nproperty float y\nproperty float z\n";
+    if(normals){
+        out << "property float nx\nproperty float ny\nproperty float nz\n";
+    }
+    if(color){
+        out << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+    }
+    out << "end_header\n";
+
+    // Interleave into one buffer so the file is written in a single call
+    size_t vertex_bytes = (normals ? 6 : 3) * sizeof(float) + (color ? 3 : 0);
+    std::vector<char> buffer(cloud.size() * vertex_bytes);
+    char* p = buffer.data();
+    for(size_t i = 0; i < cloud.size(); i++){
+        memcpy(p, &cloud.x[i], sizeof(float));
+        memcpy(p + 4, &cloud.y[i], sizeof(float));
+        memcpy(p + 8, &cloud.z[i], sizeof(float));
+        p += 12;
+        if(normals){
+            memcpy(p, &cloud.nx[i], sizeof(float));
+            memcpy(p + 4, &cloud.ny[i], sizeof(float));
+            memcpy(p + 8, &cloud.nz[i], sizeof(float));
+            p += 12;
+        }
+        if(color){
+            *p++ = (char) cloud.r[i];
+            *p++ = (char) cloud.g[i];
+            *p++ = (char) cloud.b[i];
+        }
+    }
+    out.write(buffer.data(), buffer.size());
+    return out.good();
+}
+
+namespace {
+
+size_t ply_type_size(const std::string& type)
+{
+    if(type == "char" || type == "uchar" || type == "int8" || type == "uint8"){
+        return 1;
+    }
+    if(type == "short" || type == "ushort" || type == "int16" || type == "uint16"){
+        return 2;
+    }
+    if(type == "int" || type == "uint" || type == "int32" || type == "uint32" || type == "float" || type == "float32"){
+        return 4;
+    }
+    if(type == "double" || type == "float64"){
+        return 8;
+    }
+    return 0;
+}
+
+// Converts one binary property value (little-endian host assumed, like write_ply)
+double ply_binary_value(const char* p, const std::string& type)
+{
+    size_t size = ply_type_size(type);
+    bool is_float = type.compare(0, 5, "float") == 0 || type == "double";
+    bool is_signed = !is_float && type[0] != 'u';
+    if(is_float){
+        if(size == 4){
+            float f;
+            memcpy(&f, p, 4);
+            return f;
+        }
+        double d;
+        memcpy(&d, p, 8);
+        return d;
+    }
+    int64_t value = 0;
+    uint64_t bits = 0;
+    memcpy(&bits, p, size);
+    if(is_signed && (bits >> (8 * size - 1)) & 1){
+        bits |= ~0ull << (8 * size);
+    }
+    memcpy(&value, &bits, sizeof(value));
+    return is_signed ? (double) value : (double) bits;
+}
+
+}
+
+bool read_ply(const std::string& path, point_cloud& cloud)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::string line;
+    if(!in.is_open() || !std::getline(in, line) || line.compare(0, 3, "ply") != 0){
+        return false;
+    }
+
+    // Header: only the vertex element's properties matter, elements after it are never read
+    bool binary = false;
+    bool in_vertex = false;
+    size_t vertex_count = 0;
+    std::vector<std::string> types, names;
+    while(std::getline(in, line)){
+        if(!line.empty() && line.back() == '\r'){
+            line.pop_back();
+        }
+        std::stringstream words(line);
+        std::string keyword;
+        words >> keyword;
+        if(keyword == "format"){
+            std::string format;
+            words >> format;
+            if(format == "binary_little_endian"){
+                binary = true;
+            } else if(format != "ascii"){
+                return false;
+            }
+        } else if(keyword == "element"){
+            std::string name;
+            words >> name;
+            in_vertex = name == "vertex";
+            if(in_vertex){
+                words >> vertex_count;
+            } else if(vertex_count == 0){
+                return false; // vertices have to come first for us to find them
+            }
+        } else if(keyword == "property" && in_vertex){
+            std::string type, name;
+            words >> type >> name;
+            if(type == "list" || ply_type_size(type) == 0){
+                return false;
+            }
+            types.push_back(type);
+            names.push_back(name);
+        } else if(keyword == "end_header"){
+            break;
+        }
+    }
+
+    int column[9] = {-1, -1, -1, -1, -1, -1, -1, -1, -1};
+    const char* wanted[9] = {"x", "y", "z", "red", "green", "blue", "nx", "ny", "nz"};
+    for(size_t i = 0; i < names.size(); i++){
+        for(int c = 0; c < 9; c++){
+            if(names[i] == wanted[c]){
+                column[c] = (int) i;
+            }
+        }
+    }
+    if(column[0] < 0 || column[1] < 0 || column[2] < 0){
+        return false;
+    }
+    bool color = column[3] >= 0 && column[4] >= 0 && column[5] >= 0;
+    bool normals = column[6] >= 0 && column[7] >= 0 && column[8] >= 0;
+
+    cloud.clear();
+    cloud.resize(vertex_count, color, normals);
+    std::vector<double> values(types.size());
+    std::vector<size_t> offsets(types.size());
+    size_t vertex_bytes = 0;
+    for(size_t i = 0; i < types.size(); i++){
+        offsets[i] = vertex_bytes;
+        vertex_bytes += ply_type_size(types[i]);
+    }
+
+    std::vector<char> buffer;
+    if(binary){
+        buffer.resize(vertex_count * vertex_bytes);
+        in.read(buffer.data(), buffer.size());
+        if((size_t) in.gcount() != buffer.size()){
+            return false;
+        }
+    }
+    for(size_t v = 0; v < vertex_count; v++){
+        for(size_t i = 0; i < types.size(); i++){
+            if(binary){
+                values[i] = ply_binary_value(&buffer[v * vertex_bytes + offsets[i]], types[i]);
+            } else if(!(in >> values[i])){
+                return false;
+            }
+        }
+        cloud.x[v] = (float) values[column[0]];
+        cloud.y[v] = (float) values[column[1]];
+        cloud.z[v] = (float) values[column[2]];
+        if(color){
+            cloud.r[v] = (uint8_t) values[column[3]];
+            cloud.g[v] = (uint8_t) values[column[4]];
+            cloud.b[v] = (uint8_t) values[column[5]];
+        }
+        if(normals){
+            cloud.nx[v] = (float) values[column[6]];
+            cloud.ny[v] = (float) values[column[7]];
+            cloud.nz[v] = (float) values[column[8]];
+        }
+    }
+    return true;
+}
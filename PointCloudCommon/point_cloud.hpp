@@ -0,0 +1,73 @@
+#ifndef POINT_CLOUD_HPP
+#define POINT_CLOUD_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <librealsense2/rs.hpp>
+
+// Structure-of-arrays point cloud in camera coordinates (meters).
+// Color and normal channels are empty when absent. pixel holds the depth image index (y * width + x)
+// each point came from, when the cloud was extracted from a depth frame.
+struct point_cloud {
+    std::vector<float> x, y, z;
+    std::vector<uint8_t> r, g, b;
+    std::vector<float> nx, ny, nz; // unit length, zero where no normal could be estimated
+    std::vector<uint32_t> pixel;
+
+    size_t size() const { return x.size(); }
+    bool has_color() const { return !r.empty(); }
+    bool has_normals() const { return !nx.empty(); }
+    bool has_pixel() const { return !pixel.empty(); }
+
+    void clear();
+    void reserve(size_t n, bool color, bool normals = false);
+    void resize(size_t n, bool color, bool normals = false);
+};
+
+// Color frame data looked up once so per-point sampling stays out of the librealsense API.
+// Handles RGB8 / BGR8 / RGBA8 / BGRA8; data is null for an empty frame.
+struct color_image {
+    const uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    int bytes_per_pixel = 0;
+    bool bgr = false;
+
+    color_image() {}
+    explicit color_image(const rs2::video_frame& frame);
+
+    void read(int px, int py, uint8_t& r, uint8_t& g, uint8_t& b) const
+    {
+        const uint8_t* p = data + py * stride + px * bytes_per_pixel;
+        r = p[bgr ? 2 : 0];
+        g = p[1];
+        b = p[bgr ? 0 : 2];
+    }
+
+    // Texture coordinates in [0, 1], clamped to the image
+    void sample(float u, float v, uint8_t& r, uint8_t& g, uint8_t& b) const
+    {
+        int px = std::min(std::max((int) (u * width + 0.5f), 0), width - 1);
+        int py = std::min(std::max((int) (v * height + 0.5f), 0), height - 1);
+        read(px, py, r, g, b);
+    }
+};
+
+// Converts librealsense output, sampling the color frame at each point's texture coordinate.
+// Points with zero depth are dropped unless keep_invalid is set. color may be an empty frame.
+point_cloud from_rs2_points(const rs2::points& points, const rs2::video_frame& color, bool keep_invalid = false);
+
+// The given points, in that order, with every channel the cloud has
+point_cloud select_points(const point_cloud& cloud, const std::vector<uint32_t>& indices);
+
+// Binary little-endian PLY with x/y/z and, if present, nx/ny/nz and red/green/blue
+bool write_ply(const std::string& path, const point_cloud& cloud);
+
+// Reads the vertex x/y/z, and nx/ny/nz and red/green/blue when present, from a binary little-endian or ASCII PLY.
+// Other vertex properties are skipped. Returns false if the file can't be read.
+bool read_ply(const std::string& path, point_cloud& cloud);
+
+#endif //POINT_CLOUD_HPP
@@ -0,0 +1,402 @@
+#include "point_extraction.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <librealsense2/rsutil.h>
+#include "parallel.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+depth_image::depth_image(const rs2::depth_frame& frame)
+{
+    data = static_cast<const uint16_t*>(frame.get_data());
+    width = frame.get_width();
+    height = frame.get_height();
+    stride = frame.get_stride_in_bytes() / 2;
+    depth_scale = frame.get_units();
+    profile = frame.get_profile();
+    intrinsics = profile.as<rs2::video_stream_profile>().get_intrinsics();
+}
+
+image_roi image_roi::centered(int frame_width, int frame_height, float area_fraction)
+{
+    float scale = std::sqrt(std::min(std::max(area_fraction, 0.0f), 1.0f));
+    image_roi roi;
+    roi.width = (int) (frame_width * scale + 0.5f);
+    roi.height = (int) (frame_height * scale + 0.5f);
+    roi.x = (frame_width - roi.width) / 2;
+    roi.y = (frame_height - roi.height) / 2;
+    return roi;
+}
+
+oriented_box oriented_box::from_euler(const float center[3], const float half_extents[3], float roll, float pitch, float yaw)
+{
+    const float to_rad = 3.14159265f / 180.0f;
+    float cr = std::cos(roll * to_rad), sr = std::sin(roll * to_rad);
+    float cp = std::cos(pitch * to_rad), sp = std::sin(pitch * to_rad);
+    float cy = std::cos(yaw * to_rad), sy = std::sin(yaw * to_rad);
+
+    // Box to camera rotation Ry(yaw) * Rx(pitch) * Rz(roll), stored transposed
+    float m[9] = {
+        cy * cr + sy * sp * sr, -cy * sr + sy * sp * cr, sy * cp,
+        cp * sr,                cp * cr,                 -sp,
+        -sy * cr + cy * sp * sr, sy * sr + cy * sp * cr, cy * cp
+    };
+
+    oriented_box box;
+    box.enabled = true;
+    for(int i = 0; i < 3; i++){
+        box.center[i] = center[i];
+        box.half_extents[i] = half_extents[i];
+        for(int j = 0; j < 3; j++){
+            box.rotation[3*i + j] = m[3*j + i];
+        }
+    }
+    return box;
+}
+
+// Narrows the pixel rectangle and raw depth range to what the box can cover. The rectangle is only
+// narrowed when the whole box is in front of the camera, otherwise its projection is unbounded.
+static void restrict_to_box(const oriented_box& box, const rs2_intrinsics& intrinsics, float depth_scale,
+                            int& x0, int& y0, int& x1, int& y1, double& lo, double& hi)
+{
+    float min_px = 1e9f, min_py = 1e9f, max_px = -1e9f, max_py = -1e9f;
+    float min_z = 1e9f, max_z = -1e9f;
+    for(int corner = 0; corner < 8; corner++){
+        float p[3];
+        for(int i = 0; i < 3; i++){
+            p[i] = box.center[i];
+            for(int axis = 0; axis < 3; axis++){
+                float sign = (corner >> axis) & 1 ? 1.0f : -1.0f;
+                p[i] += sign * box.half_extents[axis] * box.rotation[3*axis + i];
+            }
+        }
+        min_z = std::min(min_z, p[2]);
+        max_z = std::max(max_z, p[2]);
+        if(p[2] > 1e-3f){
+            float pixel[2];
+            rs2_project_point_to_pixel(pixel, &intrinsics, p);
+            min_px = std::min(min_px, pixel[0]);
+            max_px = std::max(max_px, pixel[0]);
+            min_py = std::min(min_py, pixel[1]);
+            max_py = std::max(max_py, pixel[1]);
+        }
+    }
+
+    lo = std::max(lo, std::ceil(min_z / depth_scale - 1e-3));
+    hi = std::min(hi, std::floor(max_z / depth_scale + 1e-3));
+    if(min_z > 1e-3f){
+        // A couple of pixels of slack for rounding and lens distortion
+        x0 = std::max(x0, (int) std::floor(min_px) - 2);
+        y0 = std::max(y0, (int) std::floor(min_py) - 2);
+        x1 = std::min(x1, (int) std::ceil(max_px) + 3);
+        y1 = std::min(y1, (int) std::ceil(max_py) + 3);
+    }
+}
+
+void point_extractor::update_rays(const rs2_intrinsics& intrinsics)
+{
+    if(!ray_x.empty() && !memcmp(&intrinsics, &ray_intrinsics, sizeof(rs2_intrinsics))){
+        return;
+    }
+    ray_intrinsics = intrinsics;
+    ray_x.resize(intrinsics.width * intrinsics.height);
+    ray_y.resize(intrinsics.width * intrinsics.height);
+    for(int y = 0; y < intrinsics.height; y++){
+        for(int x = 0; x < intrinsics.width; x++){
+            float pixel[2] = {(float) x, (float) y};
+            float point[3];
+            rs2_deproject_pixel_to_point(point, &intrinsics, pixel, 1.0f);
+            ray_x[y * intrinsics.width + x] = point[0];
+            ray_y[y * intrinsics.width + x] = point[1];
+        }
+    }
+}
+
+// Writes the image index of every pixel in [lo, hi] to out, returns the new end
+static uint32_t* compact_row(const uint16_t* row, int width, uint32_t base, uint16_t lo, uint16_t hi, uint32_t* out)
+{
+    int x = 0;
+#ifdef __SSE2__
+    // SSE2 has no unsigned 16-bit compare, but a saturating subtract is zero exactly when a <= b
+    const __m128i vlo = _mm_set1_epi16((short) lo);
+    const __m128i vhi = _mm_set1_epi16((short) hi);
+    const __m128i zero = _mm_setzero_si128();
+    for(; x + 8 <= width; x += 8){
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        __m128i above_lo = _mm_cmpeq_epi16(_mm_subs_epu16(vlo, d), zero);
+        __m128i below_hi = _mm_cmpeq_epi16(_mm_subs_epu16(d, vhi), zero);
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_packs_epi16(_mm_and_si128(above_lo, below_hi), zero));
+        if(mask == 0xFF){
+            for(int k = 0; k < 8; k++){
+                *out++ = base + x + k;
+            }
+            continue;
+        }
+        while(mask){
+            *out++ = base + x + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for(; x < width; x++){
+        if(row[x] >= lo && row[x] <= hi){
+            *out++ = base + x;
+        }
+    }
+    return out;
+}
+
+// Depth-dependent step limit in raw units: min_step + d * ratio_q16 / 65536, saturating
+static inline uint16_t flying_threshold(uint16_t d, uint16_t ratio_q16, uint16_t min_step)
+{
+    return (uint16_t) std::min<uint32_t>(65535u, min_step + (((uint32_t) d * ratio_q16) >> 16));
+}
+
+static inline bool steps_within(uint16_t d, uint16_t n, uint16_t threshold)
+{
+    return n == 0 || (d > n ? d - n : n - d) <= threshold;
+}
+
+// compact_row that also drops pixels with a depth step above the threshold to any 4-neighbor.
+// row, above and below are whole image rows (above/below are row itself at the image border),
+// [x_begin, x_end) is the part scanned. Returns the new end, flagged counts the dropped pixels.
+static uint32_t* compact_row_flying(const uint16_t* row, const uint16_t* above, const uint16_t* below, int x_begin, int x_end,
+                                    int width, uint32_t base, uint16_t lo, uint16_t hi, uint16_t ratio_q16, uint16_t min_step,
+                                    uint32_t* out, size_t& flagged)
+{
+    auto scalar = [&](int x)
+    {
+        uint16_t d = row[x];
+        if(d < lo || d > hi){
+            return;
+        }
+        uint16_t threshold = flying_threshold(d, ratio_q16, min_step);
+        bool keep = steps_within(d, x > 0 ? row[x - 1] : 0, threshold) && steps_within(d, x + 1 < width ? row[x + 1] : 0, threshold)
+                    && steps_within(d, above[x], threshold) && steps_within(d, below[x], threshold);
+        if(keep){
+            *out++ = base + x;
+        } else {
+            flagged++;
+        }
+    };
+
+    int x = x_begin;
+    for(; x < std::min(x_end, 1); x++){
+        scalar(x);
+    }
+#ifdef __SSE2__
+    const __m128i vlo = _mm_set1_epi16((short) lo);
+    const __m128i vhi = _mm_set1_epi16((short) hi);
+    const __m128i vratio = _mm_set1_epi16((short) ratio_q16);
+    const __m128i vmin = _mm_set1_epi16((short) min_step);
+    const __m128i zero = _mm_setzero_si128();
+    // Unsigned |d - n| <= t is (d -sat n) | (n -sat d) -sat t == 0, and a zero neighbor always passes
+    auto within = [&](__m128i d, __m128i n, __m128i t)
+    {
+        __m128i diff = _mm_or_si128(_mm_subs_epu16(d, n), _mm_subs_epu16(n, d));
+        return _mm_or_si128(_mm_cmpeq_epi16(_mm_subs_epu16(diff, t), zero), _mm_cmpeq_epi16(n, zero));
+    };
+    // The right neighbor load reads up to x + 8, which must stay inside the row
+    for(; x + 8 <= x_end && x + 9 <= width; x += 8){
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        __m128i in_range = _mm_and_si128(_mm_cmpeq_epi16(_mm_subs_epu16(vlo, d), zero), _mm_cmpeq_epi16(_mm_subs_epu16(d, vhi), zero));
+        __m128i t = _mm_adds_epu16(_mm_mulhi_epu16(d, vratio), vmin);
+        __m128i keep = _mm_and_si128(within(d, _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1)), t),
+                                     within(d, _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 1)), t));
+        keep = _mm_and_si128(keep, within(d, _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x)), t));
+        keep = _mm_and_si128(keep, within(d, _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x)), t));
+
+        unsigned range_mask = (unsigned) _mm_movemask_epi8(_mm_packs_epi16(in_range, zero));
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_packs_epi16(_mm_and_si128(in_range, keep), zero));
+        if(mask == 0xFF){
+            for(int k = 0; k < 8; k++){
+                *out++ = base + x + k;
+            }
+            continue;
+        }
+        flagged += __builtin_popcount(range_mask & ~mask);
+        while(mask){
+            *out++ = base + x + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for(; x < x_end; x++){
+        scalar(x);
+    }
+    return out;
+}
+
+point_cloud point_extractor::extract(const depth_image& depth, const extraction_params& params)
+{
+    update_rays(depth.intrinsics);
+    flagged = 0;
+
+    // Range in raw units, with slack for float error in the division; zero depth is always excluded
+    double lo = std::ceil((double) params.near_m / depth.depth_scale - 1e-3);
+    double hi = std::floor((double) params.far_m / depth.depth_scale + 1e-3);
+
+    // Pixel rectangle [x0, x1) x [y0, y1) that is scanned at all
+    int x0 = 0, y0 = 0, x1 = depth.width, y1 = depth.height;
+    if(!params.roi.empty()){
+        x0 = std::max(x0, params.roi.x);
+        y0 = std::max(y0, params.roi.y);
+        x1 = std::min(x1, params.roi.x + params.roi.width);
+        y1 = std::min(y1, params.roi.y + params.roi.height);
+    }
+    if(params.box.enabled){
+        restrict_to_box(params.box, depth.intrinsics, depth.depth_scale, x0, y0, x1, y1, lo, hi);
+    }
+    uint16_t raw_lo = (uint16_t) std::min(std::max(lo, 1.0), 65535.0);
+    uint16_t raw_hi = (uint16_t) std::min(std::max(hi, 0.0), 65535.0);
+    if(x1 <= x0 || y1 <= y0 || raw_hi < raw_lo){
+        return point_cloud();
+    }
+    int roi_width = x1 - x0;
+    int roi_height = y1 - y0;
+
+    unsigned num_threads = std::min(resolve_num_threads(params.num_threads), (unsigned) roi_height);
+    int rows_per_band = (roi_height + num_threads - 1) / num_threads;
+    band_indices.resize(num_threads);
+    std::vector<size_t> band_count(num_threads, 0);
+
+    bool flying = params.flying_ratio > 0;
+    uint16_t ratio_q16 = (uint16_t) std::min(params.flying_ratio * 65536.0f + 0.5f, 65535.0f);
+    uint16_t min_step = (uint16_t) std::min(std::max(params.flying_min_m / depth.depth_scale + 0.5f, 0.0f), 65535.0f);
+    std::vector<size_t> band_flagged(num_threads, 0);
+
+    // Pass 1: compact each band of rows into its own index list
+    parallel_for(num_threads, num_threads, [&](size_t begin, size_t end, unsigned) {
+        for(size_t band = begin; band < end; band++){
+            int band_y0 = std::min(y1, y0 + (int) band * rows_per_band);
+            int band_y1 = std::min(y1, band_y0 + rows_per_band);
+            std::vector<uint32_t>& indices = band_indices[band];
+            indices.resize((size_t) (band_y1 - band_y0) * roi_width);
+
+            uint32_t* out = indices.data();
+            for(int y = band_y0; y < band_y1; y++){
+                const uint16_t* row = depth.data + (size_t) y * depth.stride;
+                if(flying){
+                    const uint16_t* above = y > 0 ? row - depth.stride : row;
+                    const uint16_t* below = y + 1 < depth.height ? row + depth.stride : row;
+                    out = compact_row_flying(row, above, below, x0, x1, depth.width, (uint32_t) (y * depth.width), raw_lo, raw_hi,
+                                             ratio_q16, min_step, out, band_flagged[band]);
+                } else {
+                    out = compact_row(row + x0, roi_width, (uint32_t) (y * depth.width + x0), raw_lo, raw_hi, out);
+                }
+            }
+            band_count[band] = out - indices.data();
+        }
+    });
+    for(size_t n : band_flagged){
+        flagged += n;
+    }
+
+    std::vector<size_t> band_offset(num_threads, 0);
+    for(unsigned band = 1; band < num_threads; band++){
+        band_offset[band] = band_offset[band - 1] + band_count[band - 1];
+    }
+    size_t total = band_offset[num_threads - 1] + band_count[num_threads - 1];
+
+    point_cloud cloud;
+    cloud.resize(total, false);
+    cloud.pixel.resize(total);
+
+    // Pass 2: deproject only the valid pixels, each band into its slice of the output.
+    // With a box, points outside it are skipped so a band may fill less than its slice.
+    std::vector<size_t> band_kept(num_threads, 0);
+    parallel_for(num_threads, num_threads, [&](size_t begin, size_t end, unsigned) {
+        for(size_t band = begin; band < end; band++){
+            const uint32_t* indices = band_indices[band].data();
+            size_t out = band_offset[band];
+            for(size_t i = 0; i < band_count[band]; i++){
+                uint32_t idx = indices[i];
+                uint32_t y = idx / depth.width;
+                uint32_t x = idx - y * depth.width;
+                float z = depth.data[(size_t) y * depth.stride + x] * depth.depth_scale;
+                float px = ray_x[idx] * z;
+                float py = ray_y[idx] * z;
+                if(params.box.enabled && !params.box.contains(px, py, z)){
+                    continue;
+                }
+                cloud.x[out] = px;
+                cloud.y[out] = py;
+                cloud.z[out] = z;
+                cloud.pixel[out] = idx;
+                out++;
+            }
+            band_kept[band] = out - band_offset[band];
+        }
+    });
+
+    if(params.box.enabled){
+        // Close the gaps left by rejected points, bands stay in row order
+        size_t kept = band_kept[0];
+        for(unsigned band = 1; band < num_threads; band++){
+            size_t from = band_offset[band];
+            size_t n = band_kept[band];
+            if(from != kept){
+                std::copy(cloud.x.begin() + from, cloud.x.begin() + from + n, cloud.x.begin() + kept);
+                std::copy(cloud.y.begin() + from, cloud.y.begin() + from + n, cloud.y.begin() + kept);
+                std::copy(cloud.z.begin() + from, cloud.z.begin() + from + n, cloud.z.begin() + kept);
+                std::copy(cloud.pixel.begin() + from, cloud.pixel.begin() + from + n, cloud.pixel.begin() + kept);
+            }
+            kept += n;
+        }
+        cloud.resize(kept, false);
+        cloud.pixel.resize(kept);
+    }
+    return cloud;
+}
+
+static bool is_identity(const rs2_extrinsics& e)
+{
+    const float identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    for(int i = 0; i < 9; i++){
+        if(std::fabs(e.rotation[i] - identity[i]) > 1e-6f){
+            return false;
+        }
+    }
+    return std::fabs(e.translation[0]) < 1e-6f && std::fabs(e.translation[1]) < 1e-6f && std::fabs(e.translation[2]) < 1e-6f;
+}
+
+void map_color(point_cloud& cloud, const depth_image& depth, const rs2::video_frame& color)
+{
+    color_image image(color);
+    if(!image.data){
+        return;
+    }
+    cloud.resize(cloud.size(), true, cloud.has_normals());
+
+    rs2::stream_profile color_profile = color.get_profile();
+    rs2_extrinsics depth_to_color = depth.profile.get_extrinsics_to(color_profile);
+    bool aligned = image.width == depth.width && image.height == depth.height && is_identity(depth_to_color);
+
+    if(aligned){
+        for(size_t i = 0; i < cloud.size(); i++){
+            uint32_t y = cloud.pixel[i] / depth.width;
+            image.read(cloud.pixel[i] - y * depth.width, y, cloud.r[i], cloud.g[i], cloud.b[i]);
+        }
+        return;
+    }
+
+    rs2_intrinsics color_intrinsics = color_profile.as<rs2::video_stream_profile>().get_intrinsics();
+    for(size_t i = 0; i < cloud.size(); i++){
+        float point[3] = {cloud.x[i], cloud.y[i], cloud.z[i]};
+        float color_point[3];
+        float pixel[2];
+        rs2_transform_point_to_point(color_point, &depth_to_color, point);
+        rs2_project_point_to_pixel(pixel, &color_intrinsics, color_point);
+
+        int px = (int) (pixel[0] + 0.5f);
+        int py = (int) (pixel[1] + 0.5f);
+        if(px < 0 || py < 0 || px >= image.width || py >= image.height){
+            cloud.r[i] = cloud.g[i] = cloud.b[i] = 0;
+            continue;
+        }
+        image.read(px, py, cloud.r[i], cloud.g[i], cloud.b[i]);
+    }
+}
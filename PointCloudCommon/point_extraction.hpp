@@ -0,0 +1,106 @@
+#ifndef POINT_EXTRACTION_HPP
+#define POINT_EXTRACTION_HPP
+
+#include <cstdint>
+#include <vector>
+#include <librealsense2/rs.hpp>
+#include "point_cloud.hpp"
+
+// Z16 depth data plus what's needed to deproject it, read once per frame
+struct depth_image {
+    const uint16_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;          // in pixels
+    float depth_scale = 0;   // meters per unit
+    rs2_intrinsics intrinsics;
+    rs2::stream_profile profile;
+
+    depth_image() {}
+    explicit depth_image(const rs2::depth_frame& frame);
+};
+
+// Rectangle in depth image pixels, empty means the whole frame
+struct image_roi {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    bool empty() const { return width <= 0 || height <= 0; }
+
+    // Centered rectangle covering the given fraction of the frame area
+    static image_roi centered(int frame_width, int frame_height, float area_fraction);
+};
+
+// Box in camera coordinates. rotation rows are the box axes, so R * (p - center) is box-local.
+struct oriented_box {
+    bool enabled = false;
+    float center[3] = {0, 0, 0};
+    float rotation[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    float half_extents[3] = {0, 0, 0};
+
+    // Angles in degrees, applied as yaw (y), then pitch (x), then roll (z) in camera coordinates
+    static oriented_box from_euler(const float center[3], const float half_extents[3], float roll, float pitch, float yaw);
+
+    bool contains(float x, float y, float z) const
+    {
+        float d[3] = {x - center[0], y - center[1], z - center[2]};
+        for(int i = 0; i < 3; i++){
+            float local = rotation[3*i] * d[0] + rotation[3*i + 1] * d[1] + rotation[3*i + 2] * d[2];
+            if(local > half_extents[i] || local < -half_extents[i]){
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+struct extraction_params {
+    float near_m = 0.1f;
+    float far_m = 10.0f;
+    image_roi roi;
+    oriented_box box;
+    unsigned num_threads = 0; // 0 uses every core
+
+    // Flying pixels (mixed foreground/background returns along depth edges): a pixel is dropped when
+    // its depth differs from one of its 4 neighbors by more than flying_min_m + flying_ratio * depth.
+    // Holes (zero depth) don't count as neighbors.
+    float flying_ratio = 0;   // 0 disables
+    float flying_min_m = 0.01f;
+};
+
+// Replacement for rs2::pointcloud::calculate that only emits valid points (non-zero depth within
+// [near_m, far_m]). Valid pixels are stream-compacted per row band with SSE2 where available,
+// then deprojected through a per-pixel ray table, so later stages scale with real points
+// instead of sensor pixels. Output is dense SoA with the pixel index of every point.
+//
+// The ROI is applied during compaction: only pixels inside the image rectangle, intersected with
+// the box's projection and its depth range, are ever deprojected. Points that survive that are
+// tested against the box exactly.
+//
+// The flying-pixel test is part of the same compaction pass, on the raw Z16 rows above and below,
+// so flagged pixels are never deprojected either.
+class point_extractor {
+public:
+    point_cloud extract(const depth_image& depth, const extraction_params& params);
+
+    // In-range pixels dropped as flying pixels by the last extract()
+    size_t flying_pixels() const { return flagged; }
+
+private:
+    void update_rays(const rs2_intrinsics& intrinsics);
+
+    rs2_intrinsics ray_intrinsics = {};
+    std::vector<float> ray_x; // per pixel, x / z after undistortion
+    std::vector<float> ray_y;
+    std::vector<std::vector<uint32_t>> band_indices;
+    size_t flagged = 0;
+};
+
+// Textures an extracted cloud. When depth is aligned to color (same resolution, identity extrinsics)
+// the pixel index is used directly, otherwise points are projected into the color image.
+// Points projecting outside the color image get black.
+void map_color(point_cloud& cloud, const depth_image& depth, const rs2::video_frame& color);
+
+#endif //POINT_EXTRACTION_HPP
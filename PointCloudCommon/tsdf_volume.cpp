@@ -0,0 +1,264 @@
+#include "tsdf_volume.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include "parallel.hpp"
+
+const int tsdf_volume::block_side;
+const int tsdf_volume::block_voxels;
+
+namespace {
+
+// 21 bits per axis, biased so negative coordinates pack too
+inline uint64_t block_key(int x, int y, int z)
+{
+    const int64_t bias = 1 << 20;
+    return ((uint64_t) ((x + bias) & 0x1FFFFF) << 42) | ((uint64_t) ((y + bias) & 0x1FFFFF) << 21) | (uint64_t) ((z + bias) & 0x1FFFFF);
+}
+
+inline int floor_div(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+inline void transform_point(const float m[12], const float p[3], float out[3])
+{
+    for(int r = 0; r < 3; r++){
+        out[r] = m[4*r] * p[0] + m[4*r + 1] * p[1] + m[4*r + 2] * p[2] + m[4*r + 3];
+    }
+}
+
+// Row-major 3x4 in float, cheaper to apply per voxel
+inline void to_matrix(const rigid_transform& t, float m[12])
+{
+    for(int r = 0; r < 3; r++){
+        for(int c = 0; c < 3; c++){
+            m[4*r + c] = (float) t.rotation[3*r + c];
+        }
+        m[4*r + 3] = (float) t.translation[r];
+    }
+}
+
+}
+
+void tsdf_volume::integrate(const organized_cloud& cloud, const pinhole& camera, const rigid_transform& camera_to_world,
+                            const color_image* color)
+{
+    const float block_size = settings.voxel_size * block_side;
+    const float inv_block_size = 1.0f / block_size;
+    const unsigned num_threads = resolve_num_threads(settings.num_threads);
+    const int step = std::max(settings.allocation_step, 1);
+    if(color && (color->data == nullptr || color->width != cloud.width || color->height != cloud.height)){
+        color = nullptr;
+    }
+    colored = colored || color != nullptr;
+
+    float to_world[12], to_camera[12];
+    to_matrix(camera_to_world, to_world);
+    to_matrix(camera_to_world.inverse(), to_camera);
+
+    // Blocks within the truncation band of any measurement, gathered per thread then deduplicated
+    std::vector<std::vector<uint64_t>> thread_keys(num_threads);
+    std::vector<std::vector<int>> thread_coords(num_threads);
+    parallel_for((cloud.height + step - 1) / step, num_threads, [&](size_t begin, size_t end, unsigned t)
+    {
+        std::vector<uint64_t>& keys = thread_keys[t];
+        std::vector<int>& coords = thread_coords[t];
+        uint64_t last_key = 0;
+        bool has_last = false;
+        for(size_t row = begin; row < end; row++){
+            int v = (int) row * step;
+            for(int u = 0; u < cloud.width; u += step){
+                size_t i = cloud.index(u, v);
+                float z = cloud.z[i];
+                if(!cloud.valid[i] || z < settings.min_depth || z > settings.max_depth){
+                    continue;
+                }
+                // Walk the ray through [z - truncation, z + truncation] in half-block steps
+                int samples = (int) std::ceil(4 * settings.truncation * inv_block_size) + 1;
+                for(int s = 0; s <= samples; s++){
+                    float scale = (z - settings.truncation + 2 * settings.truncation * s / samples) / z;
+                    float p[3] = {cloud.x[i] * scale, cloud.y[i] * scale, z * scale};
+                    float w[3];
+                    transform_point(to_world, p, w);
+                    int bx = (int) std::floor(w[0] * inv_block_size);
+                    int by = (int) std::floor(w[1] * inv_block_size);
+                    int bz = (int) std::floor(w[2] * inv_block_size);
+                    uint64_t key = block_key(bx, by, bz);
+                    if(has_last && key == last_key){
+                        continue;
+                    }
+                    keys.push_back(key);
+                    coords.push_back(bx);
+                    coords.push_back(by);
+                    coords.push_back(bz);
+                    last_key = key;
+                    has_last = true;
+                }
+            }
+        }
+    });
+
+    std::vector<uint32_t> touched;
+    for(unsigned t = 0; t < num_threads; t++){
+        for(size_t k = 0; k < thread_keys[t].size(); k++){
+            auto inserted = block_index.insert(std::make_pair(thread_keys[t][k], (uint32_t) blocks.size()));
+            if(inserted.second){
+                blocks.push_back(block());
+                std::copy(&thread_coords[t][3*k], &thread_coords[t][3*k] + 3, blocks.back().coords);
+            }
+            touched.push_back(inserted.first->second);
+        }
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+    // One block at a time: project every voxel center, compare with the measured depth there
+    parallel_for(touched.size(), num_threads, [&](size_t begin, size_t end, unsigned)
+    {
+        for(size_t k = begin; k < end; k++){
+            block& b = blocks[touched[k]];
+            float origin_world[3] = {(b.coords[0] * block_side + 0.5f) * settings.voxel_size,
+                                     (b.coords[1] * block_side + 0.5f) * settings.voxel_size,
+                                     (b.coords[2] * block_side + 0.5f) * settings.voxel_size};
+            float origin[3];
+            transform_point(to_camera, origin_world, origin);
+
+            // Voxel centers step along the rotated world axes, no per-voxel matrix product
+            for(int n = 0; n < block_voxels; n++){
+                int vx = n % block_side, vy = (n / block_side) % block_side, vz = n / (block_side * block_side);
+                float p[3];
+                for(int r = 0; r < 3; r++){
+                    p[r] = origin[r] + (to_camera[4*r] * vx + to_camera[4*r + 1] * vy + to_camera[4*r + 2] * vz) * settings.voxel_size;
+                }
+                if(p[2] <= 0){
+                    continue;
+                }
+                float inv_z = 1.0f / p[2];
+                float fu = camera.fx * p[0] * inv_z + camera.cx + 0.5f;
+                float fv = camera.fy * p[1] * inv_z + camera.cy + 0.5f;
+                if(fu < 0 || fv < 0 || fu >= cloud.width || fv >= cloud.height){
+                    continue;
+                }
+                int u = (int) fu, v = (int) fv;
+                size_t i = cloud.index(u, v);
+                float depth = cloud.z[i];
+                if(!cloud.valid[i] || depth < settings.min_depth || depth > settings.max_depth){
+                    continue;
+                }
+                float sdf = depth - p[2];
+                if(sdf < -settings.truncation){
+                    continue; // behind the surface, unobserved
+                }
+
+                voxel& target = b.voxels[n];
+                float tsdf = std::min(1.0f, sdf / settings.truncation);
+                float weight = target.weight;
+                target.tsdf = (target.tsdf * weight + tsdf) / (weight + 1);
+                if(color){
+                    uint8_t r, g, bl;
+                    color->read(u, v, r, g, bl);
+                    target.r = (uint8_t) ((target.r * weight + r) / (weight + 1) + 0.5f);
+                    target.g = (uint8_t) ((target.g * weight + g) / (weight + 1) + 0.5f);
+                    target.b = (uint8_t) ((target.b * weight + bl) / (weight + 1) + 0.5f);
+                }
+                target.weight = std::min(weight + 1, settings.max_weight);
+            }
+        }
+    });
+}
+
+const tsdf_volume::voxel* tsdf_volume::find_voxel(int x, int y, int z) const
+{
+    int bx = floor_div(x, block_side), by = floor_div(y, block_side), bz = floor_div(z, block_side);
+    auto found = block_index.find(block_key(bx, by, bz));
+    if(found == block_index.end()){
+        return nullptr;
+    }
+    const block& b = blocks[found->second];
+    int vx = x - bx * block_side, vy = y - by * block_side, vz = z - bz * block_side;
+    return &b.voxels[(vz * block_side + vy) * block_side + vx];
+}
+
+point_cloud tsdf_volume::extract_surface(float min_weight) const
+{
+    const unsigned num_threads = resolve_num_threads(settings.num_threads);
+    std::vector<point_cloud> partial(num_threads);
+
+    parallel_for(blocks.size(), num_threads, [&](size_t begin, size_t end, unsigned t)
+    {
+        point_cloud& out = partial[t];
+        auto observed = [&](const voxel* v) { return v && v->weight >= min_weight; };
+
+        for(size_t k = begin; k < end; k++){
+            const block& b = blocks[k];
+            for(int n = 0; n < block_voxels; n++){
+                const voxel& center = b.voxels[n];
+                if(center.weight < min_weight || std::fabs(center.tsdf) >= 1){
+                    continue;
+                }
+                int vx = n % block_side, vy = (n / block_side) % block_side, vz = n / (block_side * block_side);
+                int g[3] = {b.coords[0] * block_side + vx, b.coords[1] * block_side + vy, b.coords[2] * block_side + vz};
+
+                for(int axis = 0; axis < 3; axis++){
+                    int o[3] = {g[0], g[1], g[2]};
+                    o[axis]++;
+                    const voxel* other = find_voxel(o[0], o[1], o[2]);
+                    if(!observed(other) || std::fabs(other->tsdf) >= 1 || (center.tsdf > 0) == (other->tsdf > 0)){
+                        continue;
+                    }
+
+                    // Zero crossing along the edge, normal from the central-difference gradient
+                    float a = center.tsdf / (center.tsdf - other->tsdf);
+                    float p[3] = {g[0] + 0.5f, g[1] + 0.5f, g[2] + 0.5f};
+                    p[axis] += a;
+
+                    float gradient[3];
+                    bool has_gradient = true;
+                    for(int d = 0; d < 3 && has_gradient; d++){
+                        int lo[3] = {g[0], g[1], g[2]}, hi[3] = {g[0], g[1], g[2]};
+                        lo[d]--;
+                        hi[d]++;
+                        const voxel* vl = find_voxel(lo[0], lo[1], lo[2]);
+                        const voxel* vh = find_voxel(hi[0], hi[1], hi[2]);
+                        has_gradient = observed(vl) && observed(vh);
+                        gradient[d] = has_gradient ? vh->tsdf - vl->tsdf : 0;
+                    }
+                    float length = std::sqrt(gradient[0] * gradient[0] + gradient[1] * gradient[1] + gradient[2] * gradient[2]);
+                    float inv_length = has_gradient && length > 0 ? 1.0f / length : 0;
+
+                    out.x.push_back(p[0] * settings.voxel_size);
+                    out.y.push_back(p[1] * settings.voxel_size);
+                    out.z.push_back(p[2] * settings.voxel_size);
+                    out.nx.push_back(gradient[0] * inv_length);
+                    out.ny.push_back(gradient[1] * inv_length);
+                    out.nz.push_back(gradient[2] * inv_length);
+                    if(colored){
+                        out.r.push_back((uint8_t) (center.r + a * (other->r - center.r) + 0.5f));
+                        out.g.push_back((uint8_t) (center.g + a * (other->g - center.g) + 0.5f));
+                        out.b.push_back((uint8_t) (center.b + a * (other->b - center.b) + 0.5f));
+                    }
+                }
+            }
+        }
+    });
+
+    point_cloud surface;
+    size_t total = 0;
+    for(const point_cloud& p : partial){
+        total += p.size();
+    }
+    surface.reserve(total, colored, true);
+    for(const point_cloud& p : partial){
+        surface.x.insert(surface.x.end(), p.x.begin(), p.x.end());
+        surface.y.insert(surface.y.end(), p.y.begin(), p.y.end());
+        surface.z.insert(surface.z.end(), p.z.begin(), p.z.end());
+        surface.nx.insert(surface.nx.end(), p.nx.begin(), p.nx.end());
+        surface.ny.insert(surface.ny.end(), p.ny.begin(), p.ny.end());
+        surface.nz.insert(surface.nz.end(), p.nz.begin(), p.nz.end());
+        surface.r.insert(surface.r.end(), p.r.begin(), p.r.end());
+        surface.g.insert(surface.g.end(), p.g.begin(), p.g.end());
+        surface.b.insert(surface.b.end(), p.b.begin(), p.b.end());
+    }
+    return surface;
+}
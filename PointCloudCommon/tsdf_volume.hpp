@@ -0,0 +1,68 @@
+#ifndef TSDF_VOLUME_HPP
+#define TSDF_VOLUME_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "icp_odometry.hpp"
+#include "organized_cloud.hpp"
+#include "point_cloud.hpp"
+
+struct tsdf_params {
+    float voxel_size = 0.01f;  // meters
+    float truncation = 0.04f;  // meters, signed distances are clamped to +-truncation
+    float max_weight = 64;     // running average turns into a moving one after this many frames
+    float min_depth = 0.1f;    // meters, measurements outside are not fused
+    float max_depth = 3.0f;
+    int allocation_step = 2;   // only every n-th pixel in x and y allocates blocks
+    unsigned num_threads = 0;  // 0 uses every core
+};
+
+// Truncated signed distance volume stored sparsely: 8x8x8 voxel blocks are allocated on demand
+// and found through a hash of their block coordinates, so memory follows the observed surface
+// rather than the bounding box of the scene.
+//
+// Each frame first allocates the blocks its measurements fall near, then integrates only those
+// blocks, one block per task. Voxels are updated by projecting their centers into the frame
+// (projective signed distance), so every block is independent and needs no locking.
+class tsdf_volume {
+public:
+    tsdf_volume() {}
+    explicit tsdf_volume(const tsdf_params& p) : settings(p) {}
+
+    // cloud in camera coordinates, camera_to_world e.g. icp_odometry::pose(). color, if given,
+    // must be in the cloud's pixel layout (color-aligned depth).
+    void integrate(const organized_cloud& cloud, const pinhole& camera, const rigid_transform& camera_to_world,
+                   const color_image* color = nullptr);
+
+    // Surface points where the distance changes sign between neighboring voxels, interpolated along
+    // the voxel edge (the vertices marching cubes would emit), with TSDF-gradient normals, and color
+    // when any frame was integrated with color. Voxels seen fewer than min_weight times are ignored.
+    point_cloud extract_surface(float min_weight = 1) const;
+
+    size_t block_count() const { return blocks.size(); }
+
+private:
+    static const int block_side = 8;
+    static const int block_voxels = block_side * block_side * block_side;
+
+    struct voxel {
+        float tsdf = 1;
+        float weight = 0;
+        uint8_t r = 0, g = 0, b = 0;
+    };
+
+    struct block {
+        int coords[3];
+        voxel voxels[block_voxels];
+    };
+
+    const voxel* find_voxel(int x, int y, int z) const;
+
+    tsdf_params settings;
+    std::unordered_map<uint64_t, uint32_t> block_index;
+    std::vector<block> blocks;
+    bool colored = false; // some frame was integrated with color
+};
+
+#endif //TSDF_VOLUME_HPP
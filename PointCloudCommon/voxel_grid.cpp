@@ -0,0 +1,149 @@
+#include "voxel_grid.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <unordered_map>
+#include "parallel.hpp"
+
+namespace {
+
+struct voxel_sum {
+    float x = 0, y = 0, z = 0;
+    uint32_t r = 0, g = 0, b = 0;
+    float nx = 0, ny = 0, nz = 0;
+    uint32_t count = 0;
+};
+
+typedef std::unordered_map<uint64_t, voxel_sum> voxel_map;
+
+// 21 bits per axis, biased so negative coordinates pack too (+-1M voxels per axis)
+inline uint64_t voxel_key(float x, float y, float z, float inv_size)
+{
+    const int64_t bias = 1 << 20;
+    uint64_t ix = (uint64_t) ((int64_t) std::floor(x * inv_size) + bias) & 0x1FFFFF;
+    uint64_t iy = (uint64_t) ((int64_t) std::floor(y * inv_size) + bias) & 0x1FFFFF;
+    uint64_t iz = (uint64_t) ((int64_t) std::floor(z * inv_size) + bias) & 0x1FFFFF;
+    return (ix << 42) | (iy << 21) | iz;
+}
+
+// Cheap mix so partitions stay balanced even though neighboring keys differ in few bits
+inline size_t partition_of(uint64_t key, size_t num_partitions)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return (size_t) (key % num_partitions);
+}
+
+}
+
+point_cloud voxel_downsample(const point_cloud& in, float voxel_size, unsigned num_threads, voxel_grid_stats* stats)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    num_threads = resolve_num_threads(num_threads);
+    const float inv_size = 1.0f / voxel_size;
+    const bool color = in.has_color();
+    const bool normals = in.has_normals();
+
+    // maps[thread][partition]
+    std::vector<std::vector<voxel_map>> maps(num_threads, std::vector<voxel_map>(num_threads));
+    parallel_for(in.size(), num_threads, [&](size_t begin, size_t end, unsigned t) {
+        std::vector<voxel_map>& local = maps[t];
+        for(voxel_map& m : local){
+            m.reserve((end - begin) / (4 * num_threads) + 16);
+        }
+        for(size_t i = begin; i < end; i++){
+            if(in.z[i] <= 0){
+                continue;
+            }
+            uint64_t key = voxel_key(in.x[i], in.y[i], in.z[i], inv_size);
+            voxel_sum& v = local[partition_of(key, num_threads)][key];
+            v.x += in.x[i];
+            v.y += in.y[i];
+            v.z += in.z[i];
+            if(color){
+                v.r += in.r[i];
+                v.g += in.g[i];
+                v.b += in.b[i];
+            }
+            if(normals){
+                v.nx += in.nx[i];
+                v.ny += in.ny[i];
+                v.nz += in.nz[i];
+            }
+            v.count++;
+        }
+    });
+
+    // Merge partition p of every thread into thread 0's map for p, then average
+    std::vector<point_cloud> partial(num_threads);
+    parallel_for(num_threads, num_threads, [&](size_t begin, size_t end, unsigned) {
+        for(size_t p = begin; p < end; p++){
+            voxel_map& merged = maps[0][p];
+            for(unsigned t = 1; t < num_threads; t++){
+                for(const auto& entry : maps[t][p]){
+                    voxel_sum& v = merged[entry.first];
+                    v.x += entry.second.x;
+                    v.y += entry.second.y;
+                    v.z += entry.second.z;
+                    v.r += entry.second.r;
+                    v.g += entry.second.g;
+                    v.b += entry.second.b;
+                    v.nx += entry.second.nx;
+                    v.ny += entry.second.ny;
+                    v.nz += entry.second.nz;
+                    v.count += entry.second.count;
+                }
+                voxel_map().swap(maps[t][p]);
+            }
+
+            point_cloud& out = partial[p];
+            out.reserve(merged.size(), color, normals);
+            for(const auto& entry : merged){
+                const voxel_sum& v = entry.second;
+                float inv_count = 1.0f / v.count;
+                out.x.push_back(v.x * inv_count);
+                out.y.push_back(v.y * inv_count);
+                out.z.push_back(v.z * inv_count);
+                if(color){
+                    out.r.push_back((uint8_t) ((v.r + v.count / 2) / v.count));
+                    out.g.push_back((uint8_t) ((v.g + v.count / 2) / v.count));
+                    out.b.push_back((uint8_t) ((v.b + v.count / 2) / v.count));
+                }
+                if(normals){
+                    // Mean direction, points without a normal added nothing to it
+                    float length = std::sqrt(v.nx * v.nx + v.ny * v.ny + v.nz * v.nz);
+                    float inv_length = length > 0 ? 1.0f / length : 0;
+                    out.nx.push_back(v.nx * inv_length);
+                    out.ny.push_back(v.ny * inv_length);
+                    out.nz.push_back(v.nz * inv_length);
+                }
+            }
+        }
+    });
+
+    point_cloud out;
+    size_t total = 0;
+    for(const point_cloud& p : partial){
+        total += p.size();
+    }
+    out.reserve(total, color, normals);
+    for(const point_cloud& p : partial){
+        out.x.insert(out.x.end(), p.x.begin(), p.x.end());
+        out.y.insert(out.y.end(), p.y.begin(), p.y.end());
+        out.z.insert(out.z.end(), p.z.begin(), p.z.end());
+        out.r.insert(out.r.end(), p.r.begin(), p.r.end());
+        out.g.insert(out.g.end(), p.g.begin(), p.g.end());
+        out.b.insert(out.b.end(), p.b.begin(), p.b.end());
+        out.nx.insert(out.nx.end(), p.nx.begin(), p.nx.end());
+        out.ny.insert(out.ny.end(), p.ny.begin(), p.ny.end());
+        out.nz.insert(out.nz.end(), p.nz.begin(), p.nz.end());
+    }
+
+    if(stats){
+        stats->points_in = in.size();
+        stats->points_out = out.size();
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return out;
+}
@@ -0,0 +1,19 @@
+#ifndef VOXEL_GRID_HPP
+#define VOXEL_GRID_HPP
+
+#include "point_cloud.hpp"
+
+struct voxel_grid_stats {
+    size_t points_in = 0;
+    size_t points_out = 0;
+    double ms = 0;
+};
+
+// Replaces all points falling into the same voxel_size cube with their average position and color.
+// Each thread accumulates its share of the points into its own hash maps, split by key into one
+// partition per thread, and each partition is then merged by a single thread without locking.
+// Points with z <= 0 are ignored. num_threads 0 uses every core.
+point_cloud voxel_downsample(const point_cloud& in, float voxel_size, unsigned num_threads = 0,
+                             voxel_grid_stats* stats = nullptr);
+
+#endif //VOXEL_GRID_HPP